@@ -3,7 +3,16 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+
+/* Limits on merging requests into one transfer. */
+#define MERGE_SECTORS 128       /* Most sectors in a merged batch. */
+#define MERGE_SEGS 32           /* Most segments in a merged batch. */
 
 /* A block device. */
 struct block
@@ -19,6 +28,26 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+    struct block_stats stats;           /* Requests submitted here. */
+    block_sector_t next_sector;         /* Where a sequential request
+                                           would begin. */
+
+    struct block *parent;               /* Device that holds this one. */
+    struct block_dispatcher *dispatcher; /* Performs queued requests. */
+    struct list_elem dispatch_elem;     /* Element in dispatcher's list. */
+    struct list queue;                  /* Queued requests, by sector. */
+    block_sector_t head;                /* Sector after last batch. */
+  };
+
+/* A kernel thread that performs the queued requests of one or
+   more block devices.  Devices that share hardware that can only
+   do one thing at a time, such as the two disks on an IDE
+   channel, should share a dispatcher. */
+struct block_dispatcher
+  {
+    struct lock lock;                   /* Protects devices' queues. */
+    struct condition work;              /* Signaled on submit. */
+    struct list devices;                /* Devices served. */
   };
 
 /* List of all block devices. */
@@ -28,6 +57,19 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void complete (struct block_request *);
+static void transfer_and_wait (struct block *, block_sector_t,
+                               const struct block_segment *, size_t seg_cnt,
+                               bool write);
+static void perform (struct block *, block_sector_t,
+                     const struct block_segment *, size_t seg_cnt,
+                     bool write);
+static list_less_func request_less;
+static thread_func dispatcher_thread NO_RETURN;
+static struct block *next_device (struct block_dispatcher *);
+static void note_queue_waits (struct list *batch);
+static void take_batch (struct block *, struct list *batch,
+                        struct block_segment[MERGE_SEGS], size_t *seg_cnt);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -120,9 +162,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_read_multiple (block, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +173,431 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  block_write_multiple (block, sector, 1, buffer);
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  The driver may move them all with one command. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer)
+{
+  struct block_segment seg;
+
+  seg.buffer = buffer;
+  seg.cnt = cnt;
+  block_read_segments (block, sector, &seg, 1);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving all
+   of the data. */
+void
+block_write_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                      const void *buffer)
+{
+  struct block_segment seg;
+
+  seg.buffer = (void *) buffer;
+  seg.cnt = cnt;
+  block_write_segments (block, sector, &seg, 1);
+}
+
+/* Reads consecutive sectors starting at SECTOR from BLOCK into
+   the SEG_CNT segments in SEGS, filling each in turn. */
+void
+block_read_segments (struct block *block, block_sector_t sector,
+                     const struct block_segment *segs, size_t seg_cnt)
+{
+  transfer_and_wait (block, sector, segs, seg_cnt, false);
+}
+
+/* Writes consecutive sectors starting at SECTOR to BLOCK from
+   the SEG_CNT segments in SEGS, taking each in turn.  Returns
+   after the block device has acknowledged receiving all of the
+   data. */
+void
+block_write_segments (struct block *block, block_sector_t sector,
+                      const struct block_segment *segs, size_t seg_cnt)
+{
+  transfer_and_wait (block, sector, segs, seg_cnt, true);
+}
+
+/* Completion function for transfer_and_wait(). */
+static void
+wake_waiter (struct block_request *r)
+{
+  sema_up (r->aux);
+}
+
+/* Submits a request to transfer SEGS to or from BLOCK starting
+   at SECTOR, and waits for it to complete. */
+static void
+transfer_and_wait (struct block *block, block_sector_t sector,
+                   const struct block_segment *segs, size_t seg_cnt,
+                   bool write)
+{
+  struct block_request r;
+  struct semaphore done;
+
+  sema_init (&done, 0);
+  r.sector = sector;
+  r.segs = segs;
+  r.seg_cnt = seg_cnt;
+  r.write = write;
+  r.done = wake_waiter;
+  r.aux = &done;
+  block_submit (block, &r);
+  sema_down (&done);
+}
+
+/* Returns the total number of sectors in the SEG_CNT segments
+   in SEGS. */
+static size_t
+segments_size (const struct block_segment *segs, size_t seg_cnt)
+{
+  size_t cnt = 0;
+  size_t i;
+
+  for (i = 0; i < seg_cnt; i++)
+    cnt += segs[i].cnt;
+  return cnt;
+}
+
+/* Starts request R on BLOCK and returns, usually before R
+   completes.  R->done is called once R has completed, possibly
+   before this function returns and possibly from another
+   thread.  R and its segments must stay alive until then.
+
+   A device with a dispatcher queues R, and the dispatcher
+   performs it in C-SCAN order, merged with requests for
+   adjacent sectors.  A device with a submit operation hands R
+   to its driver.  Otherwise, R is performed at once. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  enum intr_level old_level;
+
+  r->cnt = segments_size (r->segs, r->seg_cnt);
+  r->origin = block;
+  r->submit_time = timer_cycles ();
+  trace_record (TRACE_IO_BEGIN, thread_tid (), (uintptr_t) r);
+
+  old_level = intr_disable ();
+  if (r->sector == block->next_sector)
+    block->stats.sequential++;
+  else
+    block->stats.random++;
+  block->next_sector = r->sector + r->cnt;
+  intr_set_level (old_level);
+
+  block_forward (block, r);
+}
+
+/* Starts request R, which was submitted to another device, on
+   BLOCK, as block_submit() does.  Its statistics still go to the
+   device it was submitted to. */
+void
+block_forward (struct block *block, struct block_request *r)
+{
+  check_sector (block, r->sector);
+  if (r->cnt > block->size - r->sector)
+    PANIC ("Access past end of device %s (sector=%"PRDSNu", cnt=%zu, "
+           "size=%"PRDSNu")\n", block_name (block), r->sector, r->cnt,
+           block->size);
+  if (r->write)
+    {
+      ASSERT (block->type != BLOCK_FOREIGN);
+      block->write_cnt += r->cnt;
+    }
+  else
+    block->read_cnt += r->cnt;
+
+  if (r->cnt == 0)
+    complete (r);
+  else if (block->dispatcher != NULL)
+    {
+      struct block_dispatcher *d = block->dispatcher;
+
+      lock_acquire (&d->lock);
+      list_insert_ordered (&block->queue, &r->elem, request_less, NULL);
+      cond_signal (&d->work, &d->lock);
+      lock_release (&d->lock);
+    }
+  else if (block->ops->submit != NULL)
+    block->ops->submit (block->aux, r);
+  else
+    {
+      perform (block, r->sector, r->segs, r->seg_cnt, r->write);
+      complete (r);
+    }
+}
+
+/* Accounts for R's completion in its device's statistics, then
+   notifies R's submitter. */
+static void
+complete (struct block_request *r)
+{
+  struct block_stats *s = &r->origin->stats;
+  uint64_t latency = timer_cycles () - r->submit_time;
+  enum intr_level old_level;
+  int bucket;
+
+  for (bucket = 0; bucket < BLOCK_STATS_BUCKETS - 1; bucket++)
+    if (latency >> (bucket + 1) == 0)
+      break;
+
+  old_level = intr_disable ();
+  s->requests++;
+  if (r->write)
+    s->write_bytes += (uint64_t) r->cnt * BLOCK_SECTOR_SIZE;
+  else
+    s->read_bytes += (uint64_t) r->cnt * BLOCK_SECTOR_SIZE;
+  s->latency[bucket]++;
+  intr_set_level (old_level);
+
+  trace_record (TRACE_IO_END, thread_tid (), (uintptr_t) r);
+  r->done (r);
+}
+
+/* Orders requests by starting sector. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+  return a->sector < b->sector;
+}
+
+/* Moves consecutive sectors starting at SECTOR between BLOCK and
+   the SEG_CNT segments in SEGS using BLOCK's driver, and returns
+   once the driver is done. */
+static void
+perform (struct block *block, block_sector_t sector,
+         const struct block_segment *segs, size_t seg_cnt, bool write)
+{
+  const struct block_operations *ops = block->ops;
+  size_t i, j;
+
+  if (!write && ops->read_segments != NULL)
+    ops->read_segments (block->aux, sector, segs, seg_cnt);
+  else if (write && ops->write_segments != NULL)
+    ops->write_segments (block->aux, sector, segs, seg_cnt);
+  else
+    for (i = 0; i < seg_cnt; i++)
+      for (j = 0; j < segs[i].cnt; j++)
+        {
+          uint8_t *buffer = (uint8_t *) segs[i].buffer + j * BLOCK_SECTOR_SIZE;
+          if (write)
+            ops->write (block->aux, sector++, buffer);
+          else
+            ops->read (block->aux, sector++, buffer);
+        }
+}
+
+/* Creates and returns a dispatcher, a kernel thread named NAME
+   that performs the requests queued for the devices attached to
+   it with block_set_dispatcher(), one at a time. */
+struct block_dispatcher *
+block_dispatcher_create (const char *name)
+{
+  struct block_dispatcher *d = malloc (sizeof *d);
+  if (d == NULL)
+    PANIC ("Failed to allocate memory for block dispatcher");
+
+  lock_init (&d->lock);
+  lock_set_name (&d->lock, "dispatcher");
+  cond_init (&d->work);
+  list_init (&d->devices);
+  if (thread_create (name, PRI_MAX, dispatcher_thread, d) == TID_ERROR)
+    PANIC ("Failed to start block dispatcher %s", name);
+  return d;
+}
+
+/* Makes D perform the requests submitted to BLOCK from now on. */
+void
+block_set_dispatcher (struct block *block, struct block_dispatcher *d)
+{
+  ASSERT (block->dispatcher == NULL);
+
+  lock_acquire (&d->lock);
+  block->dispatcher = d;
+  list_push_back (&d->devices, &block->dispatch_elem);
+  lock_release (&d->lock);
+}
+
+/* Records that BLOCK is part of PARENT, as a partition is part
+   of a disk. */
+void
+block_set_parent (struct block *block, struct block *parent)
+{
+  block->parent = parent;
+}
+
+/* Returns the dispatcher that performs BLOCK's requests, or a
+   null pointer if it has none. */
+static struct block_dispatcher *
+get_dispatcher (struct block *block)
+{
+  while (block->dispatcher == NULL && block->parent != NULL)
+    block = block->parent;
+  return block->dispatcher;
+}
+
+/* Returns true if A and B's requests are performed by the same
+   dispatcher, so that I/O to one waits behind I/O to the other. */
+bool
+block_shares_dispatcher (struct block *a, struct block *b)
+{
+  struct block_dispatcher *d = get_dispatcher (a);
+  return d != NULL && d == get_dispatcher (b);
+}
+
+/* A dispatcher's thread.  Takes turns among its devices, each
+   time performing a batch of requests for one of them. */
+static void
+dispatcher_thread (void *d_)
+{
+  struct block_dispatcher *d = d_;
+
+  for (;;)
+    {
+      struct block_segment segs[MERGE_SEGS];
+      struct block_request *first;
+      struct list batch;
+      struct block *block;
+      size_t seg_cnt;
+
+      lock_acquire (&d->lock);
+      while ((block = next_device (d)) == NULL)
+        cond_wait (&d->work, &d->lock);
+      take_batch (block, &batch, segs, &seg_cnt);
+      lock_release (&d->lock);
+      note_queue_waits (&batch);
+
+      first = list_entry (list_front (&batch), struct block_request, elem);
+      if (seg_cnt > 0)
+        perform (block, first->sector, segs, seg_cnt, first->write);
+      else
+        perform (block, first->sector, first->segs, first->seg_cnt,
+                 first->write);
+
+      while (!list_empty (&batch))
+        {
+          struct block_request *r = list_entry (list_pop_front (&batch),
+                                                struct block_request, elem);
+          complete (r);
+        }
+    }
+}
+
+/* Records how long each request in BATCH, which is about to be
+   performed, waited in its queue. */
+static void
+note_queue_waits (struct list *batch)
+{
+  uint64_t now = timer_cycles ();
+  enum intr_level old_level;
+  struct list_elem *e;
+
+  old_level = intr_disable ();
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      struct block_stats *s = &r->origin->stats;
+      if (now - r->submit_time > s->max_queue_wait)
+        s->max_queue_wait = now - r->submit_time;
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns a device served by D that has queued requests, rotating
+   it to the back of D's list so that devices take turns, or a
+   null pointer if no device has any.  D's lock must be held. */
+static struct block *
+next_device (struct block_dispatcher *d)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&d->devices); e != list_end (&d->devices);
+       e = list_next (e))
+    {
+      struct block *block = list_entry (e, struct block, dispatch_elem);
+      if (!list_empty (&block->queue))
+        {
+          list_remove (e);
+          list_push_back (&d->devices, e);
+          return block;
+        }
+    }
+  return NULL;
+}
+
+/* Moves the next requests to perform from BLOCK's queue into
+   BATCH, and describes their memory in SEGS and *SEG_CNT.  Sets
+   *SEG_CNT to 0 if BATCH holds a single request whose own
+   segments must be used instead.
+
+   The head sweeps upward through the queue, which is kept in
+   sector order, and jumps back to the lowest sector when it
+   passes the last request (C-SCAN).  Requests in the same
+   direction that continue exactly where the batch ends are
+   merged into it, within MERGE_SECTORS and MERGE_SEGS.  The
+   dispatcher's lock must be held. */
+static void
+take_batch (struct block *block, struct list *batch,
+            struct block_segment segs[MERGE_SEGS], size_t *seg_cnt)
+{
+  struct list_elem *e;
+  struct block_request *first;
+  block_sector_t end;
+  size_t cnt;
+
+  list_init (batch);
+  *seg_cnt = 0;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    if (list_entry (e, struct block_request, elem)->sector >= block->head)
+      break;
+  if (e == list_end (&block->queue))
+    e = list_begin (&block->queue);
+
+  first = list_entry (e, struct block_request, elem);
+  end = first->sector;
+  cnt = 0;
+  while (e != list_end (&block->queue))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      size_t i;
+
+      if (r != first
+          && (r->sector != end || r->write != first->write
+              || cnt + r->cnt > MERGE_SECTORS
+              || *seg_cnt + r->seg_cnt > MERGE_SEGS))
+        break;
+
+      /* A request with too many segments to copy goes alone,
+         using its own segments. */
+      if (r->seg_cnt > MERGE_SEGS)
+        {
+          list_remove (e);
+          list_push_back (batch, &r->elem);
+          end += r->cnt;
+          break;
+        }
+
+      for (i = 0; i < r->seg_cnt; i++)
+        segs[(*seg_cnt)++] = r->segs[i];
+      end += r->cnt;
+      cnt += r->cnt;
+      e = list_remove (e);
+      list_push_back (batch, &r->elem);
+    }
+  block->head = end;
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -171,13 +632,45 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
+          struct block_stats s;
+          int bucket;
+
           printf ("%s (%s): %llu reads, %llu writes\n",
                   block->name, block_type_name (block->type),
                   block->read_cnt, block->write_cnt);
+
+          block_get_stats (i, &s);
+          if (s.requests == 0)
+            continue;
+          printf ("  %llu requests, %llu of them sequential, "
+                  "max queue wait %llu cycles\n",
+                  s.requests, s.sequential, s.max_queue_wait);
+          printf ("  latency histogram (log2 cycles: requests):");
+          for (bucket = 0; bucket < BLOCK_STATS_BUCKETS; bucket++)
+            if (s.latency[bucket] != 0)
+              printf (" %d:%llu", bucket, s.latency[bucket]);
+          printf ("\n");
         }
     }
 }
 
+/* Copies the statistics of the block device with the given ROLE
+   into *STATS.  Returns false if ROLE is not a role or no device
+   has it. */
+bool
+block_get_stats (enum block_type role, struct block_stats *stats)
+{
+  enum intr_level old_level;
+
+  if (role >= BLOCK_ROLE_CNT || block_by_role[role] == NULL)
+    return false;
+
+  old_level = intr_disable ();
+  *stats = block_by_role[role]->stats;
+  intr_set_level (old_level);
+  return true;
+}
+
 /* Registers a new block device with the given NAME.  If
    EXTRA_INFO is non-null, it is printed as part of a user
    message.  The block device's SIZE in sectors and its TYPE must
@@ -200,6 +693,12 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  memset (&block->stats, 0, sizeof block->stats);
+  block->next_sector = 0;
+  block->parent = NULL;
+  block->dispatcher = NULL;
+  list_init (&block->queue);
+  block->head = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
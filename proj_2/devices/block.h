@@ -1,8 +1,11 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <block-stats.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -21,6 +24,36 @@ typedef uint32_t block_sector_t;
 /* Higher-level interface for file systems, etc. */
 
 struct block;
+struct block_request;
+
+/* A piece of memory taking part in a scatter/gather transfer:
+   CNT sectors' worth of bytes at BUFFER. */
+struct block_segment
+  {
+    void *buffer;
+    size_t cnt;
+  };
+
+/* Called when a block request completes. */
+typedef void block_done_func (struct block_request *);
+
+/* An asynchronous block request, started with block_submit().
+   The submitter fills in the members up to AUX. */
+struct block_request
+  {
+    block_sector_t sector;              /* First sector. */
+    const struct block_segment *segs;   /* Memory to transfer. */
+    size_t seg_cnt;                     /* Number of segments. */
+    bool write;                         /* Write to device? */
+    block_done_func *done;              /* Called on completion. */
+    void *aux;                          /* For DONE's use. */
+
+    /* Owned by the block layer. */
+    struct list_elem elem;              /* Element in a device queue. */
+    size_t cnt;                         /* Number of sectors. */
+    struct block *origin;               /* Device first submitted to. */
+    uint64_t submit_time;               /* TSC at submission. */
+  };
 
 /* Type of a block device. */
 enum block_type
@@ -53,11 +86,22 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
+void block_read_segments (struct block *, block_sector_t,
+                          const struct block_segment *, size_t seg_cnt);
+void block_write_segments (struct block *, block_sector_t,
+                           const struct block_segment *, size_t seg_cnt);
+void block_submit (struct block *, struct block_request *);
+void block_forward (struct block *, struct block_request *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
 /* Statistics. */
 void block_print_stats (void);
+bool block_get_stats (enum block_type role, struct block_stats *);
 
 /* Lower-level interface to block device drivers. */
 
@@ -65,10 +109,29 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional.  Transfer consecutive sectors to or from a list
+       of segments as a unit.  If null, the block layer calls
+       READ or WRITE once per sector instead. */
+    void (*read_segments) (void *aux, block_sector_t,
+                           const struct block_segment *, size_t seg_cnt);
+    void (*write_segments) (void *aux, block_sector_t,
+                            const struct block_segment *, size_t seg_cnt);
+
+    /* Optional.  Takes over request R, for a device without a
+       dispatcher that passes requests on to another device with
+       block_forward(). */
+    void (*submit) (void *aux, struct block_request *r);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
 
+/* Request queueing. */
+struct block_dispatcher *block_dispatcher_create (const char *name);
+void block_set_dispatcher (struct block *, struct block_dispatcher *);
+void block_set_parent (struct block *, struct block *parent);
+bool block_shares_dispatcher (struct block *, struct block *);
+
 #endif /* devices/block.h */
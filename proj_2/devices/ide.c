@@ -3,15 +3,22 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
 #include "devices/partition.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   Data moves by bus-master DMA when the PCI IDE controller
+   supports it (as the PIIX emulated by QEMU and Bochs does), and
+   by PIO otherwise. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -34,6 +41,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +57,39 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Bus master IDE port addresses, relative to the channel's part
+   of the controller's I/O space. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0)  /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)   /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)     /* PRD table. */
+
+/* Bus master command register bits. */
+#define BM_START 0x01           /* Start transfer. */
+#define BM_READ 0x08            /* Transfer direction: 1=to memory. */
+
+/* Bus master status register bits. */
+#define BM_ERROR 0x02           /* Transfer failed (write 1 to clear). */
+#define BM_INTR 0x04            /* Interrupt raised (write 1 to clear). */
+
+/* A physical region descriptor: one piece of memory taking part
+   in a DMA transfer.  A region may not cross a 64 kB boundary,
+   and a table of them may not either. */
+struct prd
+  {
+    uint32_t addr;              /* Physical base address. */
+    uint16_t size;              /* Byte count, 0 means 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last entry. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
+
+/* Most sectors moved by one command.  A command's memory then
+   needs at most one region per sector plus one per 64 kB
+   boundary crossed, which fits easily in PRD_CNT regions. */
+#define MAX_SECTORS 128
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +98,7 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    bool dma;                   /* Use bus-master DMA? */
   };
 
 /* An ATA channel (aka controller).
@@ -72,6 +114,11 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master I/O base, 0 if none. */
+    struct prd *prdt;           /* PRD table, one page. */
+
+    struct block_dispatcher *dispatcher; /* Performs disks' requests. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -81,14 +128,24 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+static uint16_t find_bus_master (void);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void transfer (struct ata_disk *, block_sector_t,
+                      const struct block_segment *, size_t seg_cnt,
+                      bool write);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
+static void pio_transfer (struct ata_disk *, block_sector_t,
+                          const struct block_segment *, size_t seg_cnt,
+                          size_t first, size_t cnt, bool write);
+static bool dma_transfer (struct ata_disk *, block_sector_t,
+                          const struct block_segment *, size_t seg_cnt,
+                          size_t first, size_t cnt, bool write);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
@@ -101,6 +158,7 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -124,8 +182,20 @@ ide_init (void)
           NOT_REACHED ();
         }
       lock_init (&c->lock);
+      lock_set_name (&c->lock, c->name);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->bm_base = 0;
+      c->prdt = NULL;
+      c->dispatcher = NULL;
+      if (bm_base != 0)
+        {
+          /* The secondary channel's registers follow the
+             primary's. */
+          c->bm_base = bm_base + chan_no * 8;
+          c->prdt = palloc_get_page (PAL_ASSERT);
+          outl (reg_bm_prdt (c), vtop (c->prdt));
+        }
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +206,7 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -159,6 +230,65 @@ ide_init (void)
 
 static char *descramble_ata_string (char *, int size);
 
+/* PCI configuration space access ports. */
+#define PCI_CONFIG_ADDRESS 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* Reads 32-bit register REG from the configuration space of PCI
+   function FUNC of device DEV on bus BUS. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDRESS,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to 32-bit register REG in the configuration space
+   of PCI function FUNC of device DEV on bus BUS. */
+static void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDRESS,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller capable of bus
+   mastering, enables bus mastering on it, and returns the base
+   of its bus master I/O ports.  Returns 0 if there is none. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t id = pci_read_config (0, dev, func, 0x00);
+        uint32_t class = pci_read_config (0, dev, func, 0x08);
+        uint32_t bar4;
+
+        if ((id & 0xffff) == 0xffff)
+          continue;
+
+        /* Class 1 (mass storage), subclass 1 (IDE), with the
+           bus-master bit set in the programming interface. */
+        if ((class >> 16) != 0x0101 || (class & 0x8000) == 0)
+          continue;
+
+        bar4 = pci_read_config (0, dev, func, 0x20);
+        if ((bar4 & 1) == 0 || (bar4 & 0xfffc) == 0)
+          continue;
+
+        /* Enable I/O space and bus mastering. */
+        pci_write_config (0, dev, func, 0x04,
+                          pci_read_config (0, dev, func, 0x04) | 0x05);
+        return bar4 & 0xfffc;
+      }
+  return 0;
+}
+
 /* Resets an ATA channel and waits for any devices present on it
    to finish the reset. */
 static void
@@ -303,9 +433,18 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
-  /* Register. */
+  /* Use DMA if the controller can and the disk claims to. */
+  d->dma = c->bm_base != 0 && (id[49 * 2 + 1] & 0x01) != 0;
+  if (d->dma)
+    strlcat (extra_info, ", DMA", sizeof extra_info);
+
+  /* Register.  Both disks on a channel share a dispatcher, since
+     the channel can only serve one of them at a time. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
+  if (c->dispatcher == NULL)
+    c->dispatcher = block_dispatcher_create (c->name);
+  block_set_dispatcher (block, c->dispatcher);
   partition_scan (block);
 }
 
@@ -344,16 +483,11 @@ descramble_ata_string (char *string, int size)
 static void
 ide_read (void *d_, block_sector_t sec_no, void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  struct block_segment seg;
+
+  seg.buffer = buffer;
+  seg.cnt = 1;
+  transfer (d_, sec_no, &seg, 1, false);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -364,36 +498,98 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
 static void
 ide_write (void *d_, block_sector_t sec_no, const void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  struct block_segment seg;
+
+  seg.buffer = (void *) buffer;
+  seg.cnt = 1;
+  transfer (d_, sec_no, &seg, 1, true);
+}
+
+/* Reads consecutive sectors starting at SEC_NO from disk D into
+   the SEG_CNT segments in SEGS. */
+static void
+ide_read_segments (void *d_, block_sector_t sec_no,
+                   const struct block_segment *segs, size_t seg_cnt)
+{
+  transfer (d_, sec_no, segs, seg_cnt, false);
+}
+
+/* Writes consecutive sectors starting at SEC_NO to disk D from
+   the SEG_CNT segments in SEGS. */
+static void
+ide_write_segments (void *d_, block_sector_t sec_no,
+                    const struct block_segment *segs, size_t seg_cnt)
+{
+  transfer (d_, sec_no, segs, seg_cnt, true);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_segments,
+    ide_write_segments,
+    NULL
   };
-
+
+/* Moves consecutive sectors starting at SEC_NO between disk D
+   and the SEG_CNT segments in SEGS, reading the disk if WRITE is
+   false and writing it otherwise.  Issues one command per
+   MAX_SECTORS sectors, by DMA if possible and by PIO otherwise,
+   holding the channel for the whole transfer. */
+static void
+transfer (struct ata_disk *d, block_sector_t sec_no,
+          const struct block_segment *segs, size_t seg_cnt, bool write)
+{
+  struct channel *c = d->channel;
+  size_t total = 0;
+  size_t done, i;
+
+  for (i = 0; i < seg_cnt; i++)
+    total += segs[i].cnt;
+
+  lock_acquire (&c->lock);
+  for (done = 0; done < total; )
+    {
+      size_t cnt = total - done < MAX_SECTORS ? total - done : MAX_SECTORS;
+      if (!d->dma
+          || !dma_transfer (d, sec_no + done, segs, seg_cnt, done, cnt,
+                            write))
+        pio_transfer (d, sec_no + done, segs, seg_cnt, done, cnt, write);
+      done += cnt;
+    }
+  lock_release (&c->lock);
+}
+
+/* Returns the address of sector IDX of the data described by the
+   SEG_CNT segments in SEGS. */
+static uint8_t *
+segment_sector (const struct block_segment *segs, size_t seg_cnt, size_t idx)
+{
+  size_t i;
+
+  for (i = 0; i < seg_cnt; i++)
+    {
+      if (idx < segs[i].cnt)
+        return (uint8_t *) segs[i].buffer + idx * BLOCK_SECTOR_SIZE;
+      idx -= segs[i].cnt;
+    }
+  NOT_REACHED ();
+}
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT to the disk's sector selection
+   registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -429,7 +625,129 @@ output_sector (struct channel *c, const void *sector)
 {
   outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
 }
-
+
+/* Moves CNT sectors between disk D, starting at SEC_NO, and the
+   data described by the SEG_CNT segments in SEGS, starting at
+   sector FIRST of that data, by PIO with a single command.  The
+   disk interrupts once per sector.  The channel's lock must be
+   held. */
+static void
+pio_transfer (struct ata_disk *d, block_sector_t sec_no,
+              const struct block_segment *segs, size_t seg_cnt,
+              size_t first, size_t cnt, bool write)
+{
+  struct channel *c = d->channel;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, write ? CMD_WRITE_SECTOR_RETRY
+                              : CMD_READ_SECTOR_RETRY);
+  for (i = 0; i < cnt; i++)
+    {
+      uint8_t *sector = segment_sector (segs, seg_cnt, first + i);
+      if (!write)
+        {
+          sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                   d->name, sec_no + i);
+          input_sector (c, sector);
+        }
+      else
+        {
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + i);
+          output_sector (c, sector);
+          sema_down (&c->completion_wait);
+        }
+    }
+}
+
+/* Moves CNT sectors between disk D, starting at SEC_NO, and the
+   data described by the SEG_CNT segments in SEGS, starting at
+   sector FIRST of that data, by bus-master DMA with a single
+   command.  The controller copies straight from or into the
+   segments, which may be anywhere in kernel virtual memory.
+   The channel's lock must be held.  Returns true if successful.
+   On failure, turns off DMA for D and returns false, so that the
+   caller can fall back to PIO. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no,
+              const struct block_segment *segs, size_t seg_cnt,
+              size_t first, size_t cnt, bool write)
+{
+  struct channel *c = d->channel;
+  size_t sector_cnt = cnt;
+  size_t prd_cnt = 0;
+  size_t i;
+  uint8_t bm_status;
+  bool ok;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  /* Describe the memory, one region per stretch of a segment.
+     Kernel virtual memory maps physical memory contiguously, so
+     a segment only needs splitting where it crosses a 64 kB
+     boundary.  MAX_SECTORS is small enough that the table cannot
+     overflow. */
+  for (i = 0; i < seg_cnt && cnt > 0; i++)
+    {
+      uintptr_t phys;
+      size_t left, sectors;
+
+      if (first >= segs[i].cnt)
+        {
+          first -= segs[i].cnt;
+          continue;
+        }
+      sectors = segs[i].cnt - first < cnt ? segs[i].cnt - first : cnt;
+      phys = vtop ((uint8_t *) segs[i].buffer + first * BLOCK_SECTOR_SIZE);
+      left = sectors * BLOCK_SECTOR_SIZE;
+      first = 0;
+      cnt -= sectors;
+
+      while (left > 0)
+        {
+          size_t chunk = 0x10000 - (phys & 0xffff);
+          if (chunk > left)
+            chunk = left;
+          ASSERT (prd_cnt < PRD_CNT);
+          c->prdt[prd_cnt].addr = phys;
+          c->prdt[prd_cnt].size = chunk;
+          c->prdt[prd_cnt].flags = 0;
+          prd_cnt++;
+          phys += chunk;
+          left -= chunk;
+        }
+    }
+  c->prdt[prd_cnt - 1].flags = PRD_EOT;
+
+  /* Program the controller, issue the command, start the
+     transfer, and wait for the completion interrupt. */
+  outb (reg_bm_command (c), write ? 0 : BM_READ);
+  outb (reg_bm_status (c), BM_ERROR | BM_INTR);
+  select_sector (d, sec_no, sector_cnt);
+  issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), (write ? 0 : BM_READ) | BM_START);
+  sema_down (&c->completion_wait);
+  outb (reg_bm_command (c), 0);
+
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), BM_ERROR | BM_INTR);
+  ok = ((bm_status & BM_ERROR) == 0
+        && (inb (reg_alt_status (c)) & (STA_BSY | STA_DRQ | STA_ERR)) == 0);
+  if (!ok)
+    {
+      printf ("%s: DMA %s failed, sector=%"PRDSNu", using PIO\n",
+              d->name, write ? "write" : "read", sec_no);
+      d->dma = false;
+    }
+  return ok;
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -181,7 +181,9 @@ found_partition (struct block *block, uint8_t part_type,
       snprintf (name, sizeof name, "%s%d", block_name (block), part_nr);
       snprintf (extra_info, sizeof extra_info, "%s (%02x)",
                 partition_type_name (part_type), part_type);
-      block_register (name, type, extra_info, size, &partition_operations, p);
+      block_set_parent (block_register (name, type, extra_info, size,
+                                        &partition_operations, p),
+                        block);
     }
 }
 
@@ -317,8 +319,21 @@ partition_write (void *p_, block_sector_t sector, const void *buffer)
   block_write (p->block, p->start + sector, buffer);
 }
 
+/* Passes request R for partition P on to the disk that holds P,
+   so that it joins the disk's queue. */
+static void
+partition_submit (void *p_, struct block_request *r)
+{
+  struct partition *p = p_;
+  r->sector += p->start;
+  block_forward (p->block, r);
+}
+
 static struct block_operations partition_operations =
   {
     partition_read,
-    partition_write
+    partition_write,
+    NULL,
+    NULL,
+    partition_submit
   };
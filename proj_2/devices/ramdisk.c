@@ -0,0 +1,93 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A RAM disk: a block device whose sectors are kept in pages
+   from the kernel pool.  It registers as a raw device, so it
+   never takes a role by default; it must be named, as in
+   -swap=ram0.  Its contents start out zeroed and are lost at
+   power off.  Since reads and writes are plain copies, it shows
+   what a workload costs apart from disk latency. */
+
+/* Number of sectors in a page. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A RAM disk. */
+struct ramdisk
+  {
+    block_sector_t size;        /* Size in sectors. */
+    uint8_t **pages;            /* Pages holding the sectors. */
+  };
+
+static struct block_operations ramdisk_operations;
+
+/* Creates a RAM disk of SIZE sectors and registers it as block
+   device "ram0".  Panics if there is not enough memory. */
+void
+ramdisk_init (block_sector_t size)
+{
+  struct ramdisk *rd;
+  size_t page_cnt, i;
+  char extra_info[32];
+
+  ASSERT (size > 0);
+
+  page_cnt = DIV_ROUND_UP (size, SECTORS_PER_PAGE);
+  rd = malloc (sizeof *rd);
+  if (rd == NULL)
+    PANIC ("ram0: out of memory");
+  rd->size = size;
+  rd->pages = malloc (page_cnt * sizeof *rd->pages);
+  if (rd->pages == NULL)
+    PANIC ("ram0: out of memory");
+
+  /* The pages need not be contiguous, so take them one at a
+     time. */
+  for (i = 0; i < page_cnt; i++)
+    {
+      rd->pages[i] = palloc_get_page (PAL_ZERO);
+      if (rd->pages[i] == NULL)
+        PANIC ("ram0: out of memory after %zu of %zu pages", i, page_cnt);
+    }
+
+  snprintf (extra_info, sizeof extra_info, "RAM disk, %zu pages", page_cnt);
+  block_register ("ram0", BLOCK_RAW, extra_info, size,
+                  &ramdisk_operations, rd);
+}
+
+/* Returns the address of sector SEC_NO of RD. */
+static uint8_t *
+sector_addr (const struct ramdisk *rd, block_sector_t sec_no)
+{
+  ASSERT (sec_no < rd->size);
+  return (rd->pages[sec_no / SECTORS_PER_PAGE]
+          + sec_no % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads sector SEC_NO from RAM disk RD_ into BUFFER. */
+static void
+ramdisk_read (void *rd_, block_sector_t sec_no, void *buffer)
+{
+  memcpy (buffer, sector_addr (rd_, sec_no), BLOCK_SECTOR_SIZE);
+}
+
+/* Writes BUFFER to sector SEC_NO of RAM disk RD_. */
+static void
+ramdisk_write (void *rd_, block_sector_t sec_no, const void *buffer)
+{
+  memcpy (sector_addr (rd_, sec_no), buffer, BLOCK_SECTOR_SIZE);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    NULL,
+    NULL,
+    NULL
+  };
@@ -1,7 +1,7 @@
 #include "devices/serial.h"
 #include <debug.h>
+#include <string.h>
 #include "devices/input.h"
-#include "devices/intq.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
@@ -33,6 +33,13 @@
 #define MCR_REG (IO_BASE + 4)   /* MODEM Control Register. */
 #define LSR_REG (IO_BASE + 5)   /* Line Status Register (read-only). */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable receive and transmit FIFOs. */
+#define FCR_CLEAR 0x06          /* Clear both FIFOs. */
+
+/* Interrupt Identification Register bits. */
+#define IIR_FIFO 0xc0           /* FIFOs enabled. */
+
 /* Interrupt Enable Register bits. */
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
@@ -47,13 +54,39 @@
 /* Line Status Register. */
 #define LSR_DR 0x01             /* Data Ready: received data byte is in RBR. */
 #define LSR_THRE 0x20           /* THR Empty. */
+#define LSR_TEMT 0x40           /* Transmitter completely empty. */
+
+/* Depth of the 16550A's transmit FIFO. */
+#define XMIT_FIFO_SIZE 16
+
+/* Port of the Bochs and QEMU debug console. */
+#define DEBUGCON_PORT 0xe9
 
+/* Size of the transmit ring, in bytes.  Must be a power of 2. */
+#ifndef SERIAL_TXQ_SIZE
+#define SERIAL_TXQ_SIZE 4096
+#endif
+
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
-static struct intq txq;
+/* If true, output goes to the emulator's debug console instead of
+   the serial port. */
+static bool debugcon;
+
+/* Data to be transmitted.  TXQ_HEAD and TXQ_TAIL count bytes
+   ever added and removed; their difference is the number of
+   bytes queued. */
+static uint8_t txq[SERIAL_TXQ_SIZE];
+static size_t txq_head, txq_tail;
+static struct semaphore txq_room;       /* Up'd when room appears. */
+static int txq_waiters;                 /* Threads waiting for room. */
 
+/* Bytes the UART accepts at once when its transmitter is empty. */
+static int xmit_burst = 1;
+
+static size_t txq_cnt (void);
+static uint8_t txq_getc (void);
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
 static void write_ier (void);
@@ -71,7 +104,7 @@ init_poll (void)
   outb (FCR_REG, 0);                    /* Disable FIFO. */
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
-  intq_init (&txq);
+  sema_init (&txq_room, 0);
   mode = POLL;
 } 
 
@@ -90,40 +123,93 @@ serial_init_queue (void)
   intr_register_ext (0x20 + 4, serial_interrupt, "serial");
   mode = QUEUE;
   old_level = intr_disable ();
+
+  /* Turn on the FIFOs, once the last byte sent by polling is out
+     so that clearing them loses nothing.  A UART older than the
+     16550A has no FIFOs, which shows in the IIR. */
+  while ((inb (LSR_REG) & LSR_TEMT) == 0)
+    continue;
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR);
+  if ((inb (IIR_REG) & IIR_FIFO) == IIR_FIFO)
+    xmit_burst = XMIT_FIFO_SIZE;
+
   write_ier ();
   intr_set_level (old_level);
 }
 
+/* Sends output to the emulator's debug console, at port 0xe9,
+   instead of the serial port.  Bochs and QEMU take each byte
+   written there at once, without emulating a UART.  Serial
+   input is unaffected. */
+void
+serial_use_debugcon (void)
+{
+  serial_flush ();
+  debugcon = true;
+}
+
 /* Sends BYTE to the serial port. */
 void
 serial_putc (uint8_t byte) 
+{
+  serial_putbuf (&byte, 1);
+}
+
+/* Sends the N bytes in BUFFER to the serial port. */
+void
+serial_putbuf (const uint8_t *buffer, size_t n)
 {
   enum intr_level old_level = intr_disable ();
 
-  if (mode != QUEUE)
+  if (debugcon)
+    outsb (DEBUGCON_PORT, buffer, n);
+  else if (mode != QUEUE)
     {
       /* If we're not set up for interrupt-driven I/O yet,
-         use dumb polling to transmit a byte. */
+         use dumb polling to transmit. */
       if (mode == UNINIT)
         init_poll ();
-      putc_poll (byte); 
+      while (n-- > 0)
+        putc_poll (*buffer++);
     }
   else 
     {
-      /* Otherwise, queue a byte and update the interrupt enable
-         register. */
-      if (old_level == INTR_OFF && intq_full (&txq)) 
+      /* Otherwise, queue as much as fits at a time and update
+         the interrupt enable register. */
+      while (n > 0)
         {
-          /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
+          size_t room = SERIAL_TXQ_SIZE - txq_cnt ();
+          size_t ofs = txq_head % SERIAL_TXQ_SIZE;
+          size_t chunk;
+
+          if (room == 0)
+            {
+              if (old_level == INTR_OFF)
+                {
+                  /* Interrupts are off and the transmit queue is
+                     full.  If we wanted to wait for the queue to
+                     empty, we'd have to reenable interrupts.
+                     That's impolite, so we'll send a character via
+                     polling instead. */
+                  putc_poll (txq_getc ());
+                }
+              else
+                {
+                  txq_waiters++;
+                  sema_down (&txq_room);
+                }
+              continue;
+            }
+
+          chunk = n < room ? n : room;
+          if (chunk > SERIAL_TXQ_SIZE - ofs)
+            chunk = SERIAL_TXQ_SIZE - ofs;
+          memcpy (txq + ofs, buffer, chunk);
+          txq_head += chunk;
+          buffer += chunk;
+          n -= chunk;
+          write_ier ();
         }
-
-      intq_putc (&txq, byte); 
-      write_ier ();
     }
   
   intr_set_level (old_level);
@@ -135,8 +221,8 @@ void
 serial_flush (void) 
 {
   enum intr_level old_level = intr_disable ();
-  while (!intq_empty (&txq))
-    putc_poll (intq_getc (&txq));
+  while (txq_cnt () > 0)
+    putc_poll (txq_getc ());
   intr_set_level (old_level);
 }
 
@@ -182,7 +268,7 @@ write_ier (void)
 
   /* Enable transmit interrupt if we have any characters to
      transmit. */
-  if (!intq_empty (&txq))
+  if (txq_cnt () > 0)
     ier |= IER_XMIT;
 
   /* Enable receive interrupt if we have room to store any
@@ -193,6 +279,23 @@ write_ier (void)
   outb (IER_REG, ier);
 }
 
+/* Returns the number of bytes in the transmit queue. */
+static size_t
+txq_cnt (void)
+{
+  return txq_head - txq_tail;
+}
+
+/* Removes and returns the oldest byte in the transmit queue,
+   which must not be empty.  Interrupts must be off. */
+static uint8_t
+txq_getc (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (txq_cnt () > 0);
+  return txq[txq_tail++ % SERIAL_TXQ_SIZE];
+}
+
 /* Polls the serial port until it's ready,
    and then transmits BYTE. */
 static void
@@ -218,10 +321,21 @@ serial_interrupt (struct intr_frame *f UNUSED)
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  /* Once the transmitter is empty, refill it with as many bytes
+     as its FIFO holds. */
+  if ((inb (LSR_REG) & LSR_THRE) != 0)
+    {
+      int i;
+      for (i = 0; i < xmit_burst && txq_cnt () > 0; i++)
+        outb (THR_REG, txq_getc ());
+    }
+
+  /* Wake the threads waiting for room, now that there is some. */
+  while (txq_waiters > 0 && txq_cnt () < SERIAL_TXQ_SIZE)
+    {
+      txq_waiters--;
+      sema_up (&txq_room);
+    }
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
@@ -5,7 +5,9 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "threads/io.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
 #endif
@@ -130,6 +132,7 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  lock_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
 #endif
@@ -138,4 +141,6 @@ print_stats (void)
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+  if (trace_print)
+    trace_print_events ();
 }
@@ -24,22 +24,36 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Number of timer ticks over which the time stamp counter is
+   measured by timer_calibrate(). */
+#define TSC_CALIBRATE_TICKS 4
+
+/* Time stamp counter when the timer was initialized. */
+static uint64_t boot_cycles;
+
+/* Time stamp counter cycles per second.
+   Initialized by timer_calibrate(). */
+static uint64_t cycles_per_sec;
+
 static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static void calibrate_cycles (void);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
 timer_init (void) 
 {
+  boot_cycles = timer_cycles ();
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates loops_per_tick, used to implement brief delays, and
+   the rate of the time stamp counter, used by timer_ns(). */
 void
 timer_calibrate (void) 
 {
@@ -63,7 +77,44 @@ timer_calibrate (void)
     if (!too_many_loops (loops_per_tick | test_bit))
       loops_per_tick |= test_bit;
 
-  printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+  printf ("%'"PRIu64" loops/s", (uint64_t) loops_per_tick * TIMER_FREQ);
+
+  calibrate_cycles ();
+  printf (", %'"PRIu64" cycles/s.\n", cycles_per_sec);
+}
+
+/* Returns the time stamp counter, which counts CPU cycles. */
+uint64_t
+timer_cycles (void)
+{
+  uint64_t cycles;
+  asm volatile ("rdtsc" : "=A" (cycles));
+  return cycles;
+}
+
+/* Returns the number of nanoseconds since the OS booted, as
+   measured by the time stamp counter, or 0 if the timer has not
+   been calibrated yet. */
+uint64_t
+timer_ns (void)
+{
+  return timer_cycles_to_ns (timer_cycles ());
+}
+
+/* Converts CYCLES, a reading of timer_cycles(), to nanoseconds
+   since the OS booted.  Returns 0 if the timer has not been
+   calibrated yet or CYCLES is from before boot. */
+uint64_t
+timer_cycles_to_ns (uint64_t cycles)
+{
+  if (cycles_per_sec == 0 || cycles < boot_cycles)
+    return 0;
+  cycles -= boot_cycles;
+
+  /* Convert whole seconds separately, so that the product
+     cannot overflow. */
+  return (cycles / cycles_per_sec * 1000000000
+          + cycles % cycles_per_sec * 1000000000 / cycles_per_sec);
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -174,6 +225,27 @@ timer_interrupt (struct intr_frame *args UNUSED)
   thread_tick ();
 }
 
+/* Measures cycles_per_sec by counting time stamp counter cycles
+   across TSC_CALIBRATE_TICKS timer ticks. */
+static void
+calibrate_cycles (void)
+{
+  int64_t start;
+  uint64_t start_cycles;
+
+  /* Start at a timer tick. */
+  start = ticks;
+  while (ticks == start)
+    barrier ();
+
+  start = ticks;
+  start_cycles = timer_cycles ();
+  while (ticks - start < TSC_CALIBRATE_TICKS)
+    barrier ();
+  cycles_per_sec = ((timer_cycles () - start_cycles) * TIMER_FREQ
+                    / TSC_CALIBRATE_TICKS);
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool
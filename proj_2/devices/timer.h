@@ -13,6 +13,11 @@ void timer_calibrate (void);
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
 
+/* High-resolution clock. */
+uint64_t timer_cycles (void);
+uint64_t timer_ns (void);
+uint64_t timer_cycles_to_ns (uint64_t cycles);
+
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
 void timer_msleep (int64_t milliseconds);
@@ -0,0 +1,278 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* A small write-through cache of sectors on the file system
+   device.  It holds sectors fetched ahead of time by the
+   read-ahead thread, so that a sequential reader finds the next
+   sectors already in memory, and lets callers read or write part
+   of a sector without a buffer of their own.  Writes update the
+   cached copy and then go straight to disk, so a cached sector
+   never holds anything the disk does not. */
+
+/* Number of cached sectors. */
+#define CACHE_SECTORS 64
+
+/* Number of read-ahead requests that may be queued.  Requests
+   beyond this are dropped: read-ahead is only a hint. */
+#define RA_QUEUE_SIZE 16
+
+/* A cached sector. */
+struct cache_entry
+  {
+    block_sector_t sector;              /* Sector held. */
+    bool valid;                         /* Holds SECTOR's contents? */
+    bool busy;                          /* Disk I/O in progress? */
+    bool accessed;                      /* Used since the clock passed? */
+    uint8_t *data;                      /* BLOCK_SECTOR_SIZE bytes. */
+  };
+
+/* A queued read-ahead of CNT sectors starting at SECTOR. */
+struct ra_request
+  {
+    block_sector_t sector;
+    size_t cnt;
+  };
+
+static struct cache_entry entries[CACHE_SECTORS];
+static size_t clock_hand;               /* Next eviction candidate. */
+static struct lock cache_lock;          /* Protects ENTRIES, CLOCK_HAND. */
+static struct condition io_done;        /* Signaled when I/O ends. */
+
+static struct ra_request ra_queue[RA_QUEUE_SIZE];
+static size_t ra_head, ra_cnt;          /* Protected by CACHE_LOCK. */
+static struct semaphore ra_pending;     /* Up'd per queued request. */
+
+static thread_func readahead_thread NO_RETURN;
+static struct cache_entry *lookup (block_sector_t);
+static struct cache_entry *load (block_sector_t);
+static struct cache_entry *evict (void);
+
+/* Initializes the cache and starts the read-ahead thread. */
+void
+cache_init (void)
+{
+  uint8_t *pages;
+  size_t i;
+
+  pages = palloc_get_multiple (PAL_ASSERT,
+                               CACHE_SECTORS * BLOCK_SECTOR_SIZE / PGSIZE);
+  for (i = 0; i < CACHE_SECTORS; i++)
+    {
+      entries[i].valid = false;
+      entries[i].busy = false;
+      entries[i].data = pages + i * BLOCK_SECTOR_SIZE;
+    }
+  lock_init (&cache_lock);
+  lock_set_name (&cache_lock, "cache");
+  cond_init (&io_done);
+  sema_init (&ra_pending, 0);
+  thread_create ("readahead", PRI_DEFAULT, readahead_thread, NULL);
+}
+
+/* Reads SECTOR into BUFFER, from the cache if possible. */
+void
+cache_read (block_sector_t sector, void *buffer)
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes BUFFER to SECTOR. */
+void
+cache_write (block_sector_t sector, const void *buffer)
+{
+  cache_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE, true);
+}
+
+/* Reads SIZE bytes starting at byte OFS within SECTOR into
+   BUFFER, from the cache if possible. */
+void
+cache_read_at (block_sector_t sector, void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  e = lookup (sector);
+  if (e == NULL)
+    e = load (sector);
+  memcpy (buffer, e->data + ofs, size);
+  lock_release (&cache_lock);
+}
+
+/* Writes SIZE bytes from BUFFER starting at byte OFS within
+   SECTOR.  The rest of the sector keeps its contents, unless
+   FRESH is true, which means the sector holds nothing worth
+   keeping: then the rest is zeroed instead of read from disk. */
+void
+cache_write_at (block_sector_t sector, const void *buffer, int ofs, int size,
+                bool fresh)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  e = lookup (sector);
+  if (e == NULL)
+    {
+      if (fresh)
+        {
+          e = evict ();
+          e->sector = sector;
+          e->valid = true;
+          e->accessed = true;
+        }
+      else
+        e = load (sector);
+    }
+  if (fresh)
+    memset (e->data, 0, BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+
+  /* Keep others out of the entry while it is written. */
+  e->busy = true;
+  lock_release (&cache_lock);
+  block_write (fs_device, sector, e->data);
+  lock_acquire (&cache_lock);
+  e->busy = false;
+  cond_broadcast (&io_done, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Asks the read-ahead thread to bring CNT sectors starting at
+   SECTOR into the cache, and returns without waiting. */
+void
+cache_readahead (block_sector_t sector, size_t cnt)
+{
+  bool queued = false;
+
+  if (cnt == 0)
+    return;
+
+  lock_acquire (&cache_lock);
+  if (ra_cnt < RA_QUEUE_SIZE)
+    {
+      struct ra_request *r = &ra_queue[(ra_head + ra_cnt++) % RA_QUEUE_SIZE];
+      r->sector = sector;
+      r->cnt = cnt;
+      queued = true;
+    }
+  lock_release (&cache_lock);
+
+  if (queued)
+    sema_up (&ra_pending);
+}
+
+/* Read-ahead thread.  Loads each queued range into the cache,
+   skipping sectors that are already there. */
+static void
+readahead_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct ra_request r;
+      size_t i;
+
+      sema_down (&ra_pending);
+
+      lock_acquire (&cache_lock);
+      r = ra_queue[ra_head];
+      ra_head = (ra_head + 1) % RA_QUEUE_SIZE;
+      ra_cnt--;
+      for (i = 0; i < r.cnt; i++)
+        if (lookup (r.sector + i) == NULL)
+          load (r.sector + i);
+      lock_release (&cache_lock);
+    }
+}
+
+/* Returns the valid cache entry for SECTOR, waiting for its disk
+   I/O to finish if need be, or a null pointer if SECTOR is not
+   cached.  CACHE_LOCK must be held. */
+static struct cache_entry *
+lookup (block_sector_t sector)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (i = 0; i < CACHE_SECTORS; i++)
+    {
+      struct cache_entry *e = &entries[i];
+      if ((e->valid || e->busy) && e->sector == sector)
+        {
+          while (e->busy)
+            cond_wait (&io_done, &cache_lock);
+          if (e->valid && e->sector == sector)
+            {
+              e->accessed = true;
+              return e;
+            }
+          return lookup (sector);
+        }
+    }
+  return NULL;
+}
+
+/* Evicts a sector and reads SECTOR into its place.  CACHE_LOCK
+   must be held; it is released while the disk is busy so that
+   other sectors stay available. */
+static struct cache_entry *
+load (block_sector_t sector)
+{
+  struct cache_entry *e;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  e = evict ();
+  e->sector = sector;
+  e->busy = true;
+  lock_release (&cache_lock);
+  block_read (fs_device, sector, e->data);
+  lock_acquire (&cache_lock);
+  e->busy = false;
+  e->valid = true;
+  e->accessed = true;
+  cond_broadcast (&io_done, &cache_lock);
+  return e;
+}
+
+/* Chooses an entry with the clock algorithm, invalidates it, and
+   returns it.  Waits for disk I/O to finish if every entry is
+   busy.  CACHE_LOCK must be held. */
+static struct cache_entry *
+evict (void)
+{
+  size_t scanned = 0;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (;;)
+    {
+      struct cache_entry *e = &entries[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SECTORS;
+
+      if (!e->busy)
+        {
+          if (!e->valid || !e->accessed)
+            {
+              e->valid = false;
+              return e;
+            }
+          e->accessed = false;
+        }
+      else if (++scanned > CACHE_SECTORS)
+        {
+          cond_wait (&io_done, &cache_lock);
+          scanned = 0;
+        }
+    }
+}
@@ -0,0 +1,16 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+void cache_init (void);
+void cache_read (block_sector_t, void *);
+void cache_write (block_sector_t, const void *);
+void cache_read_at (block_sector_t, void *, int ofs, int size);
+void cache_write_at (block_sector_t, const void *, int ofs, int size,
+                     bool fresh);
+void cache_readahead (block_sector_t, size_t cnt);
+
+#endif /* filesys/cache.h */
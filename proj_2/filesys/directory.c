@@ -1,32 +1,184 @@
 #include "filesys/directory.h"
 #include <stdio.h>
+#include <round.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir 
   {
     struct inode *inode;                /* Backing store. */
-    off_t pos;                          /* Current position. */
+    uint32_t pos;                       /* Slot of the entry last
+                                           read by dir_readdir(). */
   };
 
-/* A single directory entry. */
+/* A single directory entry.
+
+   A directory is an open-addressed hash table of these entries:
+   NAME hashes to a home slot and collisions probe forward
+   linearly, wrapping at the end of the directory.  A slot that
+   was never used ends a probe chain; a slot freed by
+   dir_remove() is marked DELETED instead, so that entries
+   probed past it stay reachable.  dir_remove() turns such
+   markers back into never-used slots once no chain runs through
+   them.
+
+   Slot 0 holds no entry.  Instead, entries are chained through
+   the slot numbers in PREV and NEXT in the order they were
+   added, and slot 0 is the head of the chain, like the head of
+   a struct list: its NEXT is the first entry added, its PREV
+   the last, and the chain runs back to it at both ends.
+   dir_readdir() follows the chain, so it returns entries in the
+   order they were added, as it did when entries were added to
+   the first free slot. */
 struct dir_entry 
   {
     block_sector_t inode_sector;        /* Sector number of header. */
+    uint32_t prev;                      /* Slot of entry added before. */
+    uint32_t next;                      /* Slot of entry added after. */
     char name[NAME_MAX + 1];            /* Null terminated file name. */
     bool in_use;                        /* In use or free? */
+    bool deleted;                       /* Freed by dir_remove()? */
+  };
+
+/* Number of directory entry slots in a sector. */
+#define SLOTS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (struct dir_entry))
+
+/* Number of slots in the dentry cache. */
+#define DCACHE_SIZE 64
+
+/* A cached result of looking up NAME in the directory whose
+   inode is in sector DIR.  A negative entry records that the
+   name does not exist. */
+struct dcache_entry
+  {
+    bool valid;                         /* Slot in use? */
+    bool negative;                      /* NAME known to be absent? */
+    block_sector_t dir;                 /* Directory's inode sector. */
+    block_sector_t inode_sector;        /* NAME's inode, if present. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
   };
 
+/* The dentry cache, direct-mapped on directory and name.  It
+   answers dir_lookup() without reading the directory; dir_add()
+   and dir_remove() drop the entry for the name they change. */
+static struct dcache_entry dcache[DCACHE_SIZE];
+static struct lock dcache_lock;
+static unsigned dcache_gen;             /* Bumped when entries drop. */
+
+static struct dcache_entry *dcache_slot (block_sector_t dir,
+                                         const char *name);
+static void reclaim_deleted (struct dir *, uint32_t slot);
+
+/* Initializes the directory module. */
+void
+dir_init (void)
+{
+  lock_init (&dcache_lock);
+  lock_set_name (&dcache_lock, "dcache");
+}
+
+/* Returns the number of entry slots in DIR, which are numbered
+   from 1 because slot 0 is the head of the chain. */
+static size_t
+slot_cnt (const struct dir *dir)
+{
+  size_t slots = inode_length (dir->inode) / sizeof (struct dir_entry);
+  return slots > 0 ? slots - 1 : 0;
+}
+
+/* Returns the Ith slot probed for NAME in a directory with SLOTS
+   entry slots. */
+static uint32_t
+probe_slot (const char *name, size_t slots, size_t i)
+{
+  return (hash_string (name) % slots + i) % slots + 1;
+}
+
+/* Reads slot SLOT of DIR into *E.
+   Returns true if successful, false on failure. */
+static bool
+read_slot (const struct dir *dir, uint32_t slot, struct dir_entry *e)
+{
+  return inode_read_at (dir->inode, e, sizeof *e,
+                        slot * sizeof *e) == sizeof *e;
+}
+
+/* Writes E to slot SLOT of DIR.
+   Returns true if successful, false on failure. */
+static bool
+write_slot (struct dir *dir, uint32_t slot, const struct dir_entry *e)
+{
+  return inode_write_at (dir->inode, e, sizeof *e,
+                         slot * sizeof *e) == sizeof *e;
+}
+
+/* Writes E to slot SLOT of DIR as the last entry in the chain.
+   Returns true if successful, false on failure. */
+static bool
+chain_append (struct dir *dir, uint32_t slot, struct dir_entry *e)
+{
+  struct dir_entry head, tail;
+
+  if (!read_slot (dir, 0, &head))
+    return false;
+  e->prev = head.prev;
+  e->next = 0;
+  if (!write_slot (dir, slot, e))
+    return false;
+
+  /* The old last entry may be the head itself, so read each
+     slot just before changing it. */
+  if (!read_slot (dir, e->prev, &tail))
+    return false;
+  tail.next = slot;
+  if (!write_slot (dir, e->prev, &tail) || !read_slot (dir, 0, &head))
+    return false;
+  head.prev = slot;
+  return write_slot (dir, 0, &head);
+}
+
+/* Unlinks E, which was in the chain, from the entries before and
+   after it.  E keeps its own links, so that dir_readdir() can
+   still step past it.  Returns true if successful, false on
+   failure. */
+static bool
+chain_remove (struct dir *dir, const struct dir_entry *e)
+{
+  struct dir_entry prev, next;
+
+  if (!read_slot (dir, e->prev, &prev))
+    return false;
+  prev.next = e->next;
+  if (!write_slot (dir, e->prev, &prev) || !read_slot (dir, e->next, &next))
+    return false;
+  next.prev = e->prev;
+  return write_slot (dir, e->next, &next);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR.  Returns true if successful, false on failure.
+   The new directory reads as zeros, which is an empty chain. */
 bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  size_t i;
+
+  /* Forget any lookups in an old directory at SECTOR. */
+  lock_acquire (&dcache_lock);
+  for (i = 0; i < DCACHE_SIZE; i++)
+    if (dcache[i].dir == sector)
+      dcache[i].valid = false;
+  dcache_gen++;
+  lock_release (&dcache_lock);
+
+  return inode_create (sector, (entry_cnt + 1) * sizeof (struct dir_entry),
+                       true);
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -85,29 +237,36 @@ dir_get_inode (struct dir *dir)
 
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
-   if EP is non-null, and sets *OFSP to the byte offset of the
-   directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   if EP is non-null, and sets *SLOTP to the directory entry's
+   slot if SLOTP is non-null.
+   otherwise, returns false and ignores EP and SLOTP. */
 static bool
 lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
+        struct dir_entry *ep, uint32_t *slotp) 
 {
   struct dir_entry e;
-  size_t ofs;
+  size_t slots, i;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
+  slots = slot_cnt (dir);
+  for (i = 0; i < slots; i++)
+    {
+      uint32_t slot = probe_slot (name, slots, i);
+      if (!read_slot (dir, slot, &e))
+        break;
+      if (e.in_use && !strcmp (name, e.name)) 
+        {
+          if (ep != NULL)
+            *ep = e;
+          if (slotp != NULL)
+            *slotp = slot;
+          return true;
+        }
+      if (!e.in_use && !e.deleted)
+        break;
+    }
   return false;
 }
 
@@ -119,30 +278,91 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t dir_sector;
+  struct dcache_entry *d;
   struct dir_entry e;
+  unsigned gen;
+  bool found;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  dir_sector = inode_get_inumber (dir->inode);
+  if (strlen (name) > NAME_MAX)
+    {
+      *inode = NULL;
+      return false;
+    }
+
+  /* Try the dentry cache first. */
+  lock_acquire (&dcache_lock);
+  d = dcache_slot (dir_sector, name);
+  if (d->valid && d->dir == dir_sector && !strcmp (d->name, name))
+    {
+      found = !d->negative;
+      e.inode_sector = d->inode_sector;
+      lock_release (&dcache_lock);
+    }
   else
-    *inode = NULL;
+    {
+      /* Search the directory, then cache the answer unless the
+         cache dropped something meanwhile, in which case the
+         answer may already be stale. */
+      gen = dcache_gen;
+      lock_release (&dcache_lock);
+      found = lookup (dir, name, &e, NULL);
+
+      lock_acquire (&dcache_lock);
+      if (gen == dcache_gen)
+        {
+          d->valid = true;
+          d->negative = !found;
+          d->dir = dir_sector;
+          d->inode_sector = found ? e.inode_sector : 0;
+          strlcpy (d->name, name, sizeof d->name);
+        }
+      lock_release (&dcache_lock);
+    }
 
+  *inode = found ? inode_open (e.inode_sector) : NULL;
   return *inode != NULL;
 }
 
+/* Drops any dentry cache entry for NAME in DIR. */
+static void
+dcache_forget (const struct dir *dir, const char *name)
+{
+  block_sector_t dir_sector = inode_get_inumber (dir->inode);
+  struct dcache_entry *d;
+
+  lock_acquire (&dcache_lock);
+  d = dcache_slot (dir_sector, name);
+  if (d->valid && d->dir == dir_sector && !strcmp (d->name, name))
+    d->valid = false;
+  dcache_gen++;
+  lock_release (&dcache_lock);
+}
+
+/* Returns the dentry cache slot for NAME in the directory whose
+   inode is in sector DIR.  DCACHE_LOCK must be held. */
+static struct dcache_entry *
+dcache_slot (block_sector_t dir, const char *name)
+{
+  ASSERT (lock_held_by_current_thread (&dcache_lock));
+  return &dcache[(hash_string (name) ^ hash_int (dir)) % DCACHE_SIZE];
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
    Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
+   Fails if NAME is invalid (i.e. too long), if DIR has no free
+   slot, or if a disk or memory error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
   struct dir_entry e;
-  off_t ofs;
+  size_t slots, i;
   bool success = false;
 
   ASSERT (dir != NULL);
@@ -156,23 +376,30 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
+  /* Take the first free or deleted slot along NAME's probe
+     chain.  Fails if the directory is full.
      
      inode_read_at() will only return a short read at end of file.
      Otherwise, we'd need to verify that we didn't get a short
      read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
-  e.in_use = true;
-  strlcpy (e.name, name, sizeof e.name);
-  e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  slots = slot_cnt (dir);
+  for (i = 0; i < slots; i++)
+    {
+      uint32_t slot = probe_slot (name, slots, i);
+      if (!read_slot (dir, slot, &e))
+        break;
+      if (!e.in_use)
+        {
+          /* Write slot. */
+          e.in_use = true;
+          e.deleted = false;
+          strlcpy (e.name, name, sizeof e.name);
+          e.inode_sector = inode_sector;
+          success = chain_append (dir, slot, &e);
+          dcache_forget (dir, name);
+          break;
+        }
+    }
 
  done:
   return success;
@@ -187,13 +414,13 @@ dir_remove (struct dir *dir, const char *name)
   struct dir_entry e;
   struct inode *inode = NULL;
   bool success = false;
-  off_t ofs;
+  uint32_t slot;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  if (!lookup (dir, name, &e, &slot))
     goto done;
 
   /* Open inode. */
@@ -201,10 +428,14 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
-  /* Erase directory entry. */
+  /* Erase directory entry, leaving a marker so that later
+     entries in the same probe chain can still be found. */
   e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
+  e.deleted = true;
+  if (!write_slot (dir, slot, &e) || !chain_remove (dir, &e))
     goto done;
+  dcache_forget (dir, name);
+  reclaim_deleted (dir, slot);
 
   /* Remove inode. */
   inode_remove (inode);
@@ -215,22 +446,58 @@ dir_remove (struct dir *dir, const char *name)
   return success;
 }
 
+/* Turns deleted markers back into never-used slots, starting
+   from the marker just written at SLOT and working backward,
+   for as long as the slot after the marker is never-used.  No
+   probe chain can run through such a marker: every slot between
+   an entry's home and the entry was in use when it was added.
+   Stops at the start of SLOT's sector, so that removing an
+   entry logs a bounded number of directory sectors. */
+static void
+reclaim_deleted (struct dir *dir, uint32_t slot)
+{
+  size_t slots = slot_cnt (dir);
+  uint32_t first = ROUND_DOWN (slot, SLOTS_PER_SECTOR);
+  struct dir_entry e;
+
+  if (!read_slot (dir, slot % slots + 1, &e) || e.in_use || e.deleted)
+    return;
+
+  for (; slot >= first && slot > 0; slot--)
+    {
+      if (!read_slot (dir, slot, &e) || e.in_use || !e.deleted)
+        break;
+      e.deleted = false;
+      if (!write_slot (dir, slot, &e))
+        break;
+    }
+}
+
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   contains no more entries.  Entries are returned in the order
+   they were added.  If the entry last returned has since been
+   removed, its links still lead on through the entries added
+   after it, skipping any that were removed too. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
+  size_t slots = slot_cnt (dir);
   struct dir_entry e;
+  size_t i;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  if (!read_slot (dir, dir->pos, &e))
+    return false;
+  for (i = 0; i < slots && e.next != 0; i++)
     {
-      dir->pos += sizeof e;
+      dir->pos = e.next;
+      if (!read_slot (dir, dir->pos, &e))
+        return false;
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
           return true;
-        } 
+        }
     }
   return false;
 }
@@ -3,14 +3,25 @@
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Read-ahead window limits, in bytes.  A sequential reader's
+   window starts at RA_MIN and doubles on each sequential read up
+   to RA_MAX; a read anywhere else closes it. */
+#define RA_MIN (2 * BLOCK_SECTOR_SIZE)
+#define RA_MAX (32 * BLOCK_SECTOR_SIZE)
+
 /* An open file. */
 struct file 
   {
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    off_t ra_next;              /* Where a sequential read would start. */
+    off_t ra_window;            /* Read-ahead window, 0 if random. */
+    off_t ra_end;               /* End of bytes already read ahead. */
   };
 
+static void readahead (struct file *, off_t read_pos, off_t bytes_read);
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -23,6 +34,9 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->ra_next = 0;
+      file->ra_window = 0;
+      file->ra_end = 0;
       return file;
     }
   else
@@ -69,10 +83,48 @@ off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  readahead (file, file->pos, bytes_read);
   file->pos += bytes_read;
   return bytes_read;
 }
 
+/* Updates FILE's read-ahead state after BYTES_READ bytes were
+   read at READ_POS.  A read that starts where the previous one
+   ended is sequential: it grows the window and starts reading
+   the part of the window past what was already requested.  Any
+   other read collapses the window. */
+static void
+readahead (struct file *file, off_t read_pos, off_t bytes_read)
+{
+  off_t end = read_pos + bytes_read;
+
+  if (bytes_read <= 0)
+    return;
+
+  if (read_pos != file->ra_next)
+    {
+      file->ra_next = end;
+      file->ra_window = 0;
+      file->ra_end = end;
+      return;
+    }
+  file->ra_next = end;
+
+  if (file->ra_window == 0)
+    file->ra_window = RA_MIN;
+  else if (file->ra_window < RA_MAX)
+    file->ra_window *= 2;
+
+  if (file->ra_end < end)
+    file->ra_end = end;
+  if (file->ra_end < end + file->ra_window)
+    {
+      inode_readahead (file->inode, file->ra_end,
+                       end + file->ra_window - file->ra_end);
+      file->ra_end = end + file->ra_window;
+    }
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually read,
@@ -2,10 +2,12 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
@@ -13,24 +15,29 @@ struct block *fs_device;
 /* Lock for file system. */
 struct lock fs_lock;
 
-static void do_format (void);
+static void do_format (block_sector_t journal_size);
 
 /* Initializes the file system module.
-   If FORMAT is true, reformats the file system. */
+   If FORMAT is true, reformats the file system with a journal of
+   JOURNAL_SIZE sectors. */
 void
-filesys_init (bool format) 
+filesys_init (bool format, block_sector_t journal_size) 
 {
   fs_device = block_get_role (BLOCK_FILESYS);
   lock_init (&fs_lock);
+  lock_set_name (&fs_lock, "fs");
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
   inode_init ();
+  dir_init ();
+  cache_init ();
   free_map_init ();
 
   if (format) 
-    do_format ();
+    do_format (journal_size);
 
+  journal_init ();
   free_map_open ();
 }
 
@@ -40,6 +47,7 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+  journal_done ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -50,14 +58,19 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+  struct dir *dir;
+  bool success;
+
+  journal_begin (filesys_op_sectors ());
+  dir = dir_open_root ();
+  success = (dir != NULL
+             && free_map_allocate (1, &inode_sector)
+             && inode_create (inode_sector, initial_size, false)
+             && dir_add (dir, name, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
+  journal_end ();
 
   return success;
 }
@@ -87,21 +100,39 @@ filesys_open (const char *name)
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  struct dir *dir;
+  bool success;
+
+  journal_begin (filesys_op_sectors ());
+  dir = dir_open_root ();
+  success = dir != NULL && dir_remove (dir, name);
   dir_close (dir); 
+  journal_end ();
 
   return success;
 }
 
-/* Formats the file system. */
+/* Returns the most metadata sectors that one file system
+   operation can log: creating a file writes the free map, the
+   new inode, the directory's inode, and up to three sectors of
+   the directory: those holding the new entry, the entry that
+   was last before it, and the head of the chain. */
+size_t
+filesys_op_sectors (void)
+{
+  return free_map_sectors () + 5;
+}
+
+/* Formats the file system with a journal of JOURNAL_SIZE
+   sectors. */
 static void
-do_format (void)
+do_format (block_sector_t journal_size)
 {
   printf ("Formatting file system...");
   free_map_create ();
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
+  journal_format (journal_size);
   free_map_close ();
   printf ("done.\n");
 }
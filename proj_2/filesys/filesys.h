@@ -3,21 +3,24 @@
 
 #include <stdbool.h>
 #include "filesys/off_t.h"
+#include "devices/block.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2        /* Journal header sector. */
 
 /* Block device that contains the file system. */
 extern struct block *fs_device;
 
-void filesys_init (bool format);
+void filesys_init (bool format, block_sector_t journal_size);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
 struct file *filesys_open (const char *name);
 bool filesys_remove (const char *name);
+size_t filesys_op_sectors (void);
 void acquire_fs_lock (void);
 void release_fs_lock (void);
 struct thread *fs_lock_holder (void);
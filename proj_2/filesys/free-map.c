@@ -1,12 +1,16 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct lock free_map_lock;    /* Protects FREE_MAP. */
 
 /* Initializes the free map. */
 void
@@ -15,19 +19,26 @@ free_map_init (void)
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  lock_init (&free_map_lock);
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_mark (free_map, JOURNAL_SECTOR);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
    sectors were available or if the free_map file could not be
-   written. */
+   written.  File data sectors are allocated as they are first
+   written, sometimes by a thread evicting a page without the
+   file system lock, so the free map has a lock of its own. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
   if (sector != BITMAP_ERROR
       && free_map_file != NULL
       && !bitmap_write (free_map, free_map_file))
@@ -35,18 +46,40 @@ free_map_allocate (size_t cnt, block_sector_t *sectorp)
       bitmap_set_multiple (free_map, sector, cnt, false); 
       sector = BITMAP_ERROR;
     }
+  lock_release (&free_map_lock);
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Makes CNT sectors starting at SECTOR available for use once
+   the running journal transaction commits. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  ASSERT (bitmap_all (free_map, sector, cnt));
+  if (!journal_defer_release (sector, cnt))
+    free_map_release_now (sector, cnt);
+}
+
+/* Makes CNT sectors starting at SECTOR available for use
+   immediately. */
+void
+free_map_release_now (block_sector_t sector, size_t cnt)
+{
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
   bitmap_write (free_map, free_map_file);
+  lock_release (&free_map_lock);
+}
+
+/* Returns the number of sectors that one update to the free map
+   may write: the free map file's inode and all of its data. */
+size_t
+free_map_sectors (void)
+{
+  return 1 + DIV_ROUND_UP (bitmap_file_size (free_map), BLOCK_SECTOR_SIZE);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -73,7 +106,7 @@ void
 free_map_create (void) 
 {
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), true))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
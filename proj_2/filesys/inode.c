@@ -3,23 +3,55 @@
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Data sectors are found through an index: INDEX_WORDS sector
+   numbers in the inode, of which the first DIRECT_CNT name data
+   sectors, the next names an indirect block of INDIRECT_CNT data
+   sector numbers, and the last a doubly indirect block of
+   INDIRECT_CNT indirect block numbers.  Sector 0, which holds
+   the free map's inode, is never data, so a 0 in the index is a
+   hole: a sector that was never written, reads as zeros, and
+   takes no space on disk.  A file's data sectors are allocated
+   one at a time as they are first written.  Index blocks are
+   metadata, updated through the journal. */
+#define INDEX_WORDS 125
+#define DIRECT_CNT (INDEX_WORDS - 2)
+#define INDIRECT_CNT (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Most data sectors an inode can index. */
+#define MAX_SECTORS (DIRECT_CNT + INDIRECT_CNT + INDIRECT_CNT * INDIRECT_CNT)
+
+/* Files no longer than this many bytes are embedded: their data
+   lives in the inode sector, in place of the index, and they
+   have no data sectors at all. */
+#define EMBED_MAX (INDEX_WORDS * 4)
+
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    bool metadata;                      /* Directory or free map? */
+    bool embedded;                      /* Data held in EMBED? */
+    union
+      {
+        block_sector_t index[INDEX_WORDS]; /* Data sector index. */
+        uint8_t embed[EMBED_MAX];       /* Data of an embedded file. */
+      };
   };
 
+static char zeros[BLOCK_SECTOR_SIZE];
+
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
 static inline size_t
@@ -36,21 +68,188 @@ struct inode
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct lock index_lock;             /* Held while filling holes. */
     struct inode_disk data;             /* Inode content. */
   };
 
-/* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+/* Reads SIZE bytes at byte OFS within SECTOR of INODE's data
+   into BUFFER.  Metadata goes through the journal so that
+   buffered updates are seen; file data goes through the sector
+   cache. */
+static void
+read_sector (const struct inode *inode, block_sector_t sector, void *buffer,
+             int ofs, int size)
+{
+  if (inode->data.metadata)
+    journal_read_at (sector, buffer, ofs, size);
+  else
+    cache_read_at (sector, buffer, ofs, size);
+}
+
+/* Writes SIZE bytes from BUFFER at byte OFS within SECTOR of
+   INODE's data, zeroing the rest of the sector if FRESH.
+   Metadata is logged in the journal; file data is written in
+   place. */
+static void
+write_sector (const struct inode *inode, block_sector_t sector,
+              const void *buffer, int ofs, int size, bool fresh)
+{
+  if (inode->data.metadata)
+    journal_write_at (sector, buffer, ofs, size, fresh);
+  else
+    cache_write_at (sector, buffer, ofs, size, fresh);
+}
+
+/* Returns the sector that holds data sector IDX of the inode
+   whose on-disk contents, in sector INODE_SECTOR, are DISK, or 0
+   if that data sector is a hole.  If ALLOCATE, first fills a
+   hole, and any index block missing on the way to it, with a new
+   zeroed sector; then returns 0 only if the disk is full.  Must
+   be called within a journal operation if ALLOCATE. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+index_lookup (struct inode_disk *disk, block_sector_t inode_sector,
+              size_t idx, bool allocate)
 {
-  ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+  size_t path[3];
+  int depth, level;
+  block_sector_t table = 0, sector = 0;
+
+  ASSERT (idx < MAX_SECTORS);
+
+  /* Find the slot to follow at each level. */
+  if (idx < DIRECT_CNT)
+    {
+      path[0] = idx;
+      depth = 1;
+    }
+  else if (idx - DIRECT_CNT < INDIRECT_CNT)
+    {
+      path[0] = DIRECT_CNT;
+      path[1] = idx - DIRECT_CNT;
+      depth = 2;
+    }
   else
-    return -1;
+    {
+      idx -= DIRECT_CNT + INDIRECT_CNT;
+      path[0] = DIRECT_CNT + 1;
+      path[1] = idx / INDIRECT_CNT;
+      path[2] = idx % INDIRECT_CNT;
+      depth = 3;
+    }
+
+  for (level = 0; level < depth; level++)
+    {
+      if (level == 0)
+        sector = disk->index[path[0]];
+      else
+        journal_read_at (table, &sector, path[level] * sizeof sector,
+                         sizeof sector);
+      if (sector == 0)
+        {
+          if (!allocate || !free_map_allocate (1, &sector))
+            return 0;
+
+          /* Zero the new sector before linking it in, so that no
+             reader can see what it held before. */
+          if (level < depth - 1 || disk->metadata)
+            journal_write (sector, zeros);
+          else
+            cache_write (sector, zeros);
+
+          if (level == 0)
+            {
+              disk->index[path[0]] = sector;
+              journal_write (inode_sector, disk);
+            }
+          else
+            journal_write_at (table, &sector, path[level] * sizeof sector,
+                              sizeof sector, false);
+        }
+      table = sector;
+    }
+  return sector;
+}
+
+/* A run of consecutive sectors being released. */
+struct release_run
+  {
+    block_sector_t start;               /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+  };
+
+/* Adds SECTOR to the sectors released through R, releasing R's
+   run first if SECTOR does not extend it. */
+static void
+release_sector (struct release_run *r, block_sector_t sector)
+{
+  if (r->cnt > 0 && sector == r->start + r->cnt)
+    r->cnt++;
+  else
+    {
+      if (r->cnt > 0)
+        free_map_release (r->start, r->cnt);
+      r->start = sector;
+      r->cnt = 1;
+    }
+}
+
+/* Releases SECTOR, if it is not a hole, through R.  If LEVEL is
+   positive, SECTOR is an index block, and the LEVEL - 1 level
+   blocks it names are released first. */
+static void
+release_tree (struct release_run *r, block_sector_t sector, int level)
+{
+  if (sector == 0)
+    return;
+  if (level > 0)
+    {
+      block_sector_t *table = malloc (BLOCK_SECTOR_SIZE);
+      size_t i;
+
+      if (table == NULL)
+        PANIC ("can't allocate index block");
+      journal_read (sector, table);
+      for (i = 0; i < INDIRECT_CNT; i++)
+        release_tree (r, table[i], level - 1);
+      free (table);
+    }
+  release_sector (r, sector);
+}
+
+/* Releases all of DISK's data and index sectors. */
+static void
+release_index (const struct inode_disk *disk)
+{
+  struct release_run r = {0, 0};
+  size_t i;
+
+  for (i = 0; i < INDEX_WORDS; i++)
+    release_tree (&r, disk->index[i],
+                  i < DIRECT_CNT ? 0 : (int) (i - DIRECT_CNT) + 1);
+  if (r.cnt > 0)
+    free_map_release (r.start, r.cnt);
+}
+
+/* Returns the sector that holds data sector IDX of INODE, or 0
+   if it is a hole.  If ALLOCATE, fills a hole first, and returns
+   0 only if the disk is full. */
+static block_sector_t
+data_sector (struct inode *inode, size_t idx, bool allocate)
+{
+  block_sector_t sector = index_lookup (&inode->data, inode->sector, idx,
+                                        false);
+
+  if (sector == 0 && allocate)
+    {
+      /* Allocating logs the free map, the inode, and up to two
+         index blocks. */
+      journal_begin (free_map_sectors () + 3);
+      lock_acquire (&inode->index_lock);
+      sector = index_lookup (&inode->data, inode->sector, idx, true);
+      lock_release (&inode->index_lock);
+      journal_end ();
+    }
+  return sector;
 }
 
 /* List of open inodes, so that opening a single inode twice
@@ -66,11 +265,17 @@ inode_init (void)
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The data starts out as one hole, which reads as zeros
+   and takes no disk space until it is written.  A file of at
+   most EMBED_MAX bytes gets no data sectors; its data is kept in
+   the inode itself.
+   METADATA marks directories and the free map, whose contents
+   are updated through the journal.  Their sectors are allocated
+   here, so that updating them later cannot run out of space.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool metadata)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -87,19 +292,20 @@ inode_create (block_sector_t sector, off_t length)
       size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      disk_inode->metadata = metadata;
+      disk_inode->embedded = length <= EMBED_MAX;
+      success = disk_inode->embedded || sectors <= MAX_SECTORS;
+      if (success && metadata && !disk_inode->embedded) 
         {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+          size_t i;
+
+          for (i = 0; i < sectors && success; i++)
+            success = index_lookup (disk_inode, sector, i, true) != 0;
+          if (!success)
+            release_index (disk_inode);
+        }
+      if (success)
+        journal_write (sector, disk_inode);
       free (disk_inode);
     }
   return success;
@@ -137,7 +343,8 @@ inode_open (block_sector_t sector)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  lock_init (&inode->index_lock);
+  journal_read (inode->sector, &inode->data);
   return inode;
 }
 
@@ -173,12 +380,13 @@ inode_close (struct inode *inode)
       /* Remove from inode list and release lock. */
       list_remove (&inode->elem);
  
-      /* Deallocate blocks if removed. */
+      /* Deallocate blocks if removed.  With a journal they are
+         released when the running transaction commits. */
       if (inode->removed) 
         {
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          if (!inode->data.embedded)
+            release_index (&inode->data);
         }
 
       free (inode); 
@@ -202,13 +410,22 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+
+  if (inode->data.embedded)
+    {
+      if (offset >= inode->data.length)
+        return 0;
+      if (size > inode->data.length - offset)
+        size = inode->data.length - offset;
+      memcpy (buffer, inode->data.embed + offset, size);
+      return size;
+    }
 
   while (size > 0) 
     {
-      /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      /* Starting byte offset within sector. */
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      block_sector_t sector_idx;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
       off_t inode_left = inode_length (inode) - offset;
@@ -220,23 +437,17 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      sector_idx = data_sector (inode, offset / BLOCK_SECTOR_SIZE, false);
+      if (sector_idx == 0)
         {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
+          /* A hole reads as zeros. */
+          memset (buffer + bytes_read, 0, chunk_size);
         }
-      else 
+      else
         {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          /* Copy the chunk out of the cached sector. */
+          read_sector (inode, sector_idx, buffer + bytes_read,
+                       sector_ofs, chunk_size);
         }
       
       /* Advance. */
@@ -244,7 +455,6 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
 
   return bytes_read;
 }
@@ -260,16 +470,30 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
   if (inode->deny_write_cnt)
     return 0;
 
+  if (inode->data.embedded)
+    {
+      /* The inode sector is metadata, so the new data is logged
+         with it. */
+      if (offset >= inode->data.length)
+        return 0;
+      if (size > inode->data.length - offset)
+        size = inode->data.length - offset;
+      memcpy (inode->data.embed + offset, buffer, size);
+      journal_begin (1);
+      journal_write (inode->sector, &inode->data);
+      journal_end ();
+      return size;
+    }
+
   while (size > 0) 
     {
-      /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      /* Starting byte offset within sector. */
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      block_sector_t sector_idx;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
       off_t inode_left = inode_length (inode) - offset;
@@ -281,42 +505,64 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
+      /* Fill a hole with a sector first.  Stop if the disk is
+         full. */
+      sector_idx = data_sector (inode, offset / BLOCK_SECTOR_SIZE, true);
+      if (sector_idx == 0)
+        break;
 
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      /* If the sector contains data before or after the chunk
+         we're writing, then the cache merges the chunk into it.
+         Otherwise the chunk goes into a sector of all zeros. */
+      write_sector (inode, sector_idx, buffer + bytes_written,
+                    sector_ofs, chunk_size,
+                    sector_ofs == 0 && chunk_size >= sector_left);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
 
   return bytes_written;
 }
 
+/* Starts reading the sectors that hold bytes OFFSET through
+   OFFSET + SIZE - 1 of INODE into the sector cache, without
+   waiting for them.  Holes are skipped, since reading them costs
+   nothing. */
+void
+inode_readahead (struct inode *inode, off_t offset, off_t size)
+{
+  size_t first, last, idx, run = 0;
+  block_sector_t start = 0;
+
+  if (inode->data.metadata || inode->data.embedded
+      || offset >= inode_length (inode) || size <= 0)
+    return;
+  if (size > inode_length (inode) - offset)
+    size = inode_length (inode) - offset;
+
+  first = offset / BLOCK_SECTOR_SIZE;
+  last = (offset + size - 1) / BLOCK_SECTOR_SIZE;
+  for (idx = first; idx <= last; idx++)
+    {
+      /* Queue each run of consecutive sectors as one request. */
+      block_sector_t sector = data_sector (inode, idx, false);
+      if (run > 0 && sector == start + run)
+        run++;
+      else
+        {
+          if (run > 0)
+            cache_readahead (start, run);
+          start = sector;
+          run = sector != 0;
+        }
+    }
+  if (run > 0)
+    cache_readahead (start, run);
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -0,0 +1,477 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* The journal is a write-ahead log of metadata sectors: inodes,
+   directory contents and the free map.  Metadata writes made
+   between journal_begin() and journal_end() are buffered in
+   memory as part of the running transaction, which collects the
+   updates of every operation that ends before the next commit.
+   A commit copies the buffered sectors into the journal area,
+   writes a descriptor sector naming their home locations (the
+   commit point), then writes them home and retires the
+   descriptor by bumping the sequence number in the header.
+   After a crash, journal_init() replays a descriptor that was
+   written but not retired.
+
+   Each operation reserves room for the most sectors it may log
+   when it begins, so that the running transaction never
+   outgrows the journal.  An operation that does not fit waits
+   for the running transaction to commit.
+
+   Sectors freed by a transaction are not returned to the free
+   map until it commits, so that data written to a reallocated
+   sector can never land on top of metadata that a replay would
+   still need. */
+
+/* Identifies the journal header and a committed descriptor. */
+#define JOURNAL_MAGIC 0x4a524e4c
+#define COMMIT_MAGIC 0x434d4954
+
+/* Home sectors recorded by one descriptor sector. */
+#define DESC_SLOTS 125
+
+/* Smallest and largest useful journal sizes, in sectors: one
+   descriptor plus its logged sectors. */
+#define JOURNAL_MIN_SIZE 16
+#define JOURNAL_MAX_SIZE (DESC_SLOTS + 1)
+
+/* Ticks after which the next journal_end() commits, even if the
+   running transaction is still small. */
+#define COMMIT_TICKS TIMER_FREQ
+
+/* Journal header, kept in JOURNAL_SECTOR.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_header
+  {
+    unsigned magic;                     /* JOURNAL_MAGIC. */
+    block_sector_t start;               /* First sector of journal area. */
+    block_sector_t size;                /* Journal area size, 0 if none. */
+    uint32_t seq;                       /* Last retired descriptor. */
+    uint32_t unused[124];               /* Not used. */
+  };
+
+/* Commit descriptor, the first sector of the journal area.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_desc
+  {
+    unsigned magic;                     /* COMMIT_MAGIC. */
+    uint32_t seq;                       /* Header seq + 1 if committed. */
+    uint32_t cnt;                       /* Number of logged sectors. */
+    block_sector_t home[DESC_SLOTS];    /* Home of each logged sector. */
+  };
+
+/* A metadata sector buffered in the running transaction. */
+struct journal_block
+  {
+    struct hash_elem elem;              /* Element in running. */
+    block_sector_t sector;              /* Home sector. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Latest contents. */
+  };
+
+/* Sectors whose release waits for the running transaction. */
+struct deferred_release
+  {
+    struct list_elem elem;              /* Element in deferred. */
+    block_sector_t sector;              /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+  };
+
+static struct journal_header header;    /* Cached JOURNAL_SECTOR. */
+static size_t capacity;                 /* Max sectors per transaction. */
+static bool enabled;                    /* Journal in use? */
+
+static struct lock journal_lock;        /* Protects the state below. */
+static struct condition handles_done;   /* Signaled when handles hits 0. */
+static struct condition commit_done;    /* Signaled when a commit ends. */
+static int handles;                     /* Operations in progress. */
+static size_t reserved;                 /* Sectors reserved by handles. */
+static bool committing;                 /* Commit in progress? */
+static struct hash running;             /* Running transaction's sectors. */
+static struct list deferred;            /* Releases awaiting commit. */
+static int64_t last_commit;             /* Tick of the last commit. */
+
+static void commit (void);
+static hash_hash_func block_hash;
+static hash_less_func block_less;
+static hash_action_func block_free;
+
+/* Writes an empty journal of SIZE sectors to the file system
+   device, which must be freshly formatted.  A SIZE of 0 formats
+   the file system without a journal. */
+void
+journal_format (block_sector_t size)
+{
+  ASSERT (sizeof header == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct journal_desc) == BLOCK_SECTOR_SIZE);
+
+  if (size != 0 && size < JOURNAL_MIN_SIZE)
+    size = JOURNAL_MIN_SIZE;
+  if (size > JOURNAL_MAX_SIZE)
+    size = JOURNAL_MAX_SIZE;
+  if (size != 0 && size - 1 < filesys_op_sectors ())
+    PANIC ("journal of %"PRDSNu" sectors is too small for this disk, "
+           "need at least %zu", size, filesys_op_sectors () + 1);
+
+  memset (&header, 0, sizeof header);
+  header.magic = JOURNAL_MAGIC;
+  if (size > 0 && !free_map_allocate (size, &header.start))
+    PANIC ("journal creation failed");
+  header.size = size;
+
+  /* A zeroed descriptor never looks committed. */
+  if (size > 0)
+    {
+      static struct journal_desc empty;
+      block_write (fs_device, header.start, &empty);
+    }
+  block_write (fs_device, JOURNAL_SECTOR, &header);
+}
+
+/* Opens the journal and replays a transaction that was
+   committed but not yet written home. */
+void
+journal_init (void)
+{
+  lock_init (&journal_lock);
+  lock_set_name (&journal_lock, "journal");
+  cond_init (&handles_done);
+  cond_init (&commit_done);
+  hash_init (&running, block_hash, block_less, NULL);
+  list_init (&deferred);
+
+  block_read (fs_device, JOURNAL_SECTOR, &header);
+  if (header.magic != JOURNAL_MAGIC)
+    {
+      printf ("journal: no journal header, not journaling\n");
+      return;
+    }
+  if (header.size == 0)
+    return;
+  capacity = header.size - 1;
+
+  struct journal_desc *desc = malloc (sizeof *desc);
+  void *buffer = malloc (BLOCK_SECTOR_SIZE);
+  if (desc == NULL || buffer == NULL)
+    PANIC ("can't allocate journal replay buffers");
+
+  block_read (fs_device, header.start, desc);
+  if (desc->magic == COMMIT_MAGIC && desc->seq == header.seq + 1
+      && desc->cnt <= capacity)
+    {
+      size_t i;
+
+      for (i = 0; i < desc->cnt; i++)
+        {
+          block_read (fs_device, header.start + 1 + i, buffer);
+          cache_write (desc->home[i], buffer);
+        }
+      header.seq = desc->seq;
+      block_write (fs_device, JOURNAL_SECTOR, &header);
+      printf ("journal: replayed %"PRIu32" sectors\n", desc->cnt);
+    }
+  free (buffer);
+  free (desc);
+
+  if (capacity < filesys_op_sectors ())
+    {
+      printf ("journal: %"PRDSNu" sectors is too small, not journaling\n",
+              header.size);
+      return;
+    }
+  last_commit = timer_ticks ();
+  enabled = true;
+}
+
+/* Commits any buffered metadata.  Called at shutdown. */
+void
+journal_done (void)
+{
+  if (enabled)
+    commit ();
+}
+
+/* Starts an operation whose metadata writes must reach the disk
+   atomically.  SECTORS is the most distinct sectors that the
+   operation may log, including those of operations nested in
+   it.  Calls may nest within a thread; only the outermost pair
+   delimits the operation and reserves space. */
+void
+journal_begin (size_t sectors)
+{
+  struct thread *cur = thread_current ();
+
+  if (!enabled || cur->journal_depth++ > 0)
+    return;
+  ASSERT (sectors <= capacity);
+
+  lock_acquire (&journal_lock);
+  while (committing || hash_size (&running) + reserved + sectors > capacity)
+    if (committing)
+      cond_wait (&commit_done, &journal_lock);
+    else
+      {
+        /* No room: commit what is there to start afresh. */
+        lock_release (&journal_lock);
+        commit ();
+        lock_acquire (&journal_lock);
+      }
+  handles++;
+  reserved += sectors;
+  cur->journal_reserved = sectors;
+  lock_release (&journal_lock);
+}
+
+/* Ends an operation started with journal_begin().  Commits the
+   running transaction if it is getting full or has been running
+   for COMMIT_TICKS, so that the cost of a commit is shared by
+   all the operations in it. */
+void
+journal_end (void)
+{
+  struct thread *cur = thread_current ();
+  bool due;
+
+  if (!enabled || --cur->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  reserved -= cur->journal_reserved;
+  if (--handles == 0)
+    cond_broadcast (&handles_done, &journal_lock);
+  due = (!committing
+         && (hash_size (&running) >= capacity / 2
+             || timer_elapsed (last_commit) >= COMMIT_TICKS));
+  lock_release (&journal_lock);
+
+  if (due)
+    commit ();
+}
+
+/* Reads metadata SECTOR into BUFFER, seeing any update buffered
+   in the running transaction. */
+void
+journal_read (block_sector_t sector, void *buffer)
+{
+  journal_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes BUFFER to metadata SECTOR as part of the running
+   transaction.  Must be called between journal_begin() and
+   journal_end(). */
+void
+journal_write (block_sector_t sector, const void *buffer)
+{
+  journal_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE, true);
+}
+
+/* Reads SIZE bytes starting at byte OFS within metadata SECTOR
+   into BUFFER, seeing any update buffered in the running
+   transaction. */
+void
+journal_read_at (block_sector_t sector, void *buffer, int ofs, int size)
+{
+  if (enabled)
+    {
+      struct journal_block key;
+      struct hash_elem *e;
+
+      key.sector = sector;
+      lock_acquire (&journal_lock);
+      e = hash_find (&running, &key.elem);
+      if (e != NULL)
+        memcpy (buffer, hash_entry (e, struct journal_block, elem)->data + ofs,
+                size);
+      lock_release (&journal_lock);
+      if (e != NULL)
+        return;
+    }
+  cache_read_at (sector, buffer, ofs, size);
+}
+
+/* Writes SIZE bytes from BUFFER starting at byte OFS within
+   metadata SECTOR, as part of the running transaction.  The rest
+   of the sector keeps its contents, or is zeroed if FRESH is
+   true.  Must be called between journal_begin() and
+   journal_end(). */
+void
+journal_write_at (block_sector_t sector, const void *buffer, int ofs,
+                  int size, bool fresh)
+{
+  struct journal_block key;
+  struct journal_block *b;
+  struct hash_elem *e;
+
+  if (!enabled)
+    {
+      cache_write_at (sector, buffer, ofs, size, fresh);
+      return;
+    }
+  ASSERT (thread_current ()->journal_depth > 0);
+
+  key.sector = sector;
+  lock_acquire (&journal_lock);
+  e = hash_find (&running, &key.elem);
+  if (e != NULL)
+    {
+      b = hash_entry (e, struct journal_block, elem);
+      if (fresh)
+        memset (b->data, 0, BLOCK_SECTOR_SIZE);
+    }
+  else
+    {
+      b = malloc (sizeof *b);
+      if (b == NULL)
+        PANIC ("can't allocate journal block");
+      b->sector = sector;
+      if (fresh)
+        memset (b->data, 0, BLOCK_SECTOR_SIZE);
+      else
+        cache_read (sector, b->data);
+      hash_insert (&running, &b->elem);
+    }
+  memcpy (b->data + ofs, buffer, size);
+  lock_release (&journal_lock);
+}
+
+/* Arranges for CNT sectors starting at SECTOR to be returned to
+   the free map once the running transaction commits.  Returns
+   false if there is no journal, in which case the caller should
+   release them at once. */
+bool
+journal_defer_release (block_sector_t sector, size_t cnt)
+{
+  struct deferred_release *r;
+
+  if (!enabled)
+    return false;
+
+  r = malloc (sizeof *r);
+  if (r == NULL)
+    PANIC ("can't allocate deferred release");
+  r->sector = sector;
+  r->cnt = cnt;
+  lock_acquire (&journal_lock);
+  list_push_back (&deferred, &r->elem);
+  lock_release (&journal_lock);
+  return true;
+}
+
+/* Waits for operations in progress to end, then writes the
+   running transaction to the journal and to its home sectors.
+   Finally releases the sectors the transaction freed, which
+   starts the next transaction. */
+static void
+commit (void)
+{
+  struct journal_desc *desc;
+  struct hash_iterator i;
+  struct list released;
+  size_t cnt;
+
+  lock_acquire (&journal_lock);
+  if (committing)
+    {
+      /* Someone else is already committing for us. */
+      while (committing)
+        cond_wait (&commit_done, &journal_lock);
+      lock_release (&journal_lock);
+      return;
+    }
+  committing = true;
+  while (handles > 0)
+    cond_wait (&handles_done, &journal_lock);
+
+  cnt = hash_size (&running);
+  if (cnt > 0)
+    {
+      ASSERT (cnt <= capacity);
+      desc = calloc (1, sizeof *desc);
+      if (desc == NULL)
+        PANIC ("can't allocate journal descriptor");
+
+      /* Log the sectors, then write the descriptor that makes
+         them count. */
+      hash_first (&i, &running);
+      while (hash_next (&i))
+        {
+          struct journal_block *b = hash_entry (hash_cur (&i),
+                                                struct journal_block, elem);
+          block_write (fs_device, header.start + 1 + desc->cnt, b->data);
+          desc->home[desc->cnt++] = b->sector;
+        }
+      desc->magic = COMMIT_MAGIC;
+      desc->seq = header.seq + 1;
+      block_write (fs_device, header.start, desc);
+
+      /* Checkpoint, then retire the descriptor. */
+      hash_first (&i, &running);
+      while (hash_next (&i))
+        {
+          struct journal_block *b = hash_entry (hash_cur (&i),
+                                                struct journal_block, elem);
+          cache_write (b->sector, b->data);
+        }
+      header.seq = desc->seq;
+      block_write (fs_device, JOURNAL_SECTOR, &header);
+
+      hash_clear (&running, block_free);
+      free (desc);
+    }
+  last_commit = timer_ticks ();
+
+  list_init (&released);
+  while (!list_empty (&deferred))
+    list_push_back (&released, list_pop_front (&deferred));
+
+  committing = false;
+  cond_broadcast (&commit_done, &journal_lock);
+  lock_release (&journal_lock);
+
+  if (!list_empty (&released))
+    {
+      journal_begin (free_map_sectors ());
+      while (!list_empty (&released))
+        {
+          struct deferred_release *r
+            = list_entry (list_pop_front (&released),
+                          struct deferred_release, elem);
+          free_map_release_now (r->sector, r->cnt);
+          free (r);
+        }
+      journal_end ();
+    }
+}
+
+/* Returns a hash value for journal block E. */
+static unsigned
+block_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct journal_block, elem)->sector);
+}
+
+/* Returns true if journal block A precedes journal block B. */
+static bool
+block_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct journal_block, elem)->sector
+          < hash_entry (b, struct journal_block, elem)->sector);
+}
+
+/* Frees journal block E. */
+static void
+block_free (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct journal_block, elem));
+}
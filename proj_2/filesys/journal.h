@@ -0,0 +1,27 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Default size of the journal made by a format, in sectors. */
+#define JOURNAL_DEFAULT_SIZE 64
+
+void journal_format (block_sector_t size);
+void journal_init (void);
+void journal_done (void);
+
+/* Grouping metadata updates into atomic operations. */
+void journal_begin (size_t sectors);
+void journal_end (void);
+
+/* Metadata sector I/O. */
+void journal_read (block_sector_t, void *);
+void journal_write (block_sector_t, const void *);
+void journal_read_at (block_sector_t, void *, int ofs, int size);
+void journal_write_at (block_sector_t, const void *, int ofs, int size,
+                       bool fresh);
+bool journal_defer_release (block_sector_t, size_t cnt);
+
+#endif /* filesys/journal.h */
@@ -0,0 +1,34 @@
+#ifndef __LIB_BLOCK_STATS_H
+#define __LIB_BLOCK_STATS_H
+
+#include <stdint.h>
+
+/* Block device roles that statistics can be requested for.
+   These match the kernel's enum block_type. */
+#define BLOCK_STATS_KERNEL 0    /* Pintos OS kernel. */
+#define BLOCK_STATS_FILESYS 1   /* File system. */
+#define BLOCK_STATS_SCRATCH 2   /* Scratch. */
+#define BLOCK_STATS_SWAP 3      /* Swap. */
+
+/* Number of latency histogram buckets. */
+#define BLOCK_STATS_BUCKETS 40
+
+/* Statistics for one block device.  Times are in CPU cycles, as
+   counted by the time stamp counter. */
+struct block_stats
+  {
+    uint64_t requests;          /* Requests completed. */
+    uint64_t read_bytes;        /* Bytes read. */
+    uint64_t write_bytes;       /* Bytes written. */
+    uint64_t sequential;        /* Requests that began where the
+                                   previous one ended. */
+    uint64_t random;            /* Other requests. */
+    uint64_t max_queue_wait;    /* Longest wait to be dispatched. */
+
+    /* latency[i] counts requests that took between 2**i and
+       2**(i+1) - 1 cycles from submission to completion.  The
+       last bucket also counts everything slower. */
+    uint64_t latency[BLOCK_STATS_BUCKETS];
+  };
+
+#endif /* lib/block-stats.h */
@@ -9,6 +9,16 @@
 
 static void vprintf_helper (char, void *);
 static void putchar_have_lock (uint8_t c);
+static void putbuf_have_lock (const char *, size_t);
+
+/* Output of one vprintf() call, gathered so that it reaches the
+   serial port in batches rather than a character at a time. */
+struct vprintf_buffer
+  {
+    char buf[64];               /* Characters not yet written. */
+    size_t len;                 /* Number of characters in BUF. */
+    int char_cnt;               /* Number of characters so far. */
+  };
 
 /* The console lock.
    Both the vga and serial layers do their own locking, so it's
@@ -64,6 +74,7 @@ void
 console_init (void) 
 {
   lock_init (&console_lock);
+  lock_set_name (&console_lock, "console");
   use_console_lock = true;
 }
 
@@ -125,13 +136,17 @@ console_locked_by_current_thread (void)
 int
 vprintf (const char *format, va_list args) 
 {
-  int char_cnt = 0;
+  struct vprintf_buffer b;
+
+  b.len = 0;
+  b.char_cnt = 0;
 
   acquire_console ();
-  __vprintf (format, args, vprintf_helper, &char_cnt);
+  __vprintf (format, args, vprintf_helper, &b);
+  putbuf_have_lock (b.buf, b.len);
   release_console ();
 
-  return char_cnt;
+  return b.char_cnt;
 }
 
 /* Writes string S to the console, followed by a new-line
@@ -153,8 +168,7 @@ void
 putbuf (const char *buffer, size_t n) 
 {
   acquire_console ();
-  while (n-- > 0)
-    putchar_have_lock (*buffer++);
+  putbuf_have_lock (buffer, n);
   release_console ();
 }
 
@@ -171,11 +185,16 @@ putchar (int c)
 
 /* Helper function for vprintf(). */
 static void
-vprintf_helper (char c, void *char_cnt_) 
+vprintf_helper (char c, void *b_) 
 {
-  int *char_cnt = char_cnt_;
-  (*char_cnt)++;
-  putchar_have_lock (c);
+  struct vprintf_buffer *b = b_;
+  b->char_cnt++;
+  b->buf[b->len++] = c;
+  if (b->len >= sizeof b->buf)
+    {
+      putbuf_have_lock (b->buf, b->len);
+      b->len = 0;
+    }
 }
 
 /* Writes C to the vga display and serial port.
@@ -189,3 +208,16 @@ putchar_have_lock (uint8_t c)
   serial_putc (c);
   vga_putc (c);
 }
+
+/* Writes the N characters in BUFFER to the vga display and
+   serial port.  The caller has already acquired the console
+   lock if appropriate. */
+static void
+putbuf_have_lock (const char *buffer, size_t n)
+{
+  ASSERT (console_locked_by_current_thread ());
+  write_cnt += n;
+  serial_putbuf ((const uint8_t *) buffer, n);
+  while (n-- > 0)
+    vga_putc (*buffer++);
+}
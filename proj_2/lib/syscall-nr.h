@@ -28,7 +28,11 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Diagnostics. */
+    SYS_BLOCK_STATS,            /* Obtain a block device's statistics. */
+    SYS_TIME_NS                 /* Read the high-resolution clock. */
   };
 
 #endif /* lib/syscall-nr.h */
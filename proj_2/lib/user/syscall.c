@@ -182,3 +182,17 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+block_stats (int role, struct block_stats *stats)
+{
+  return syscall2 (SYS_BLOCK_STATS, role, stats);
+}
+
+uint64_t
+time_ns (void)
+{
+  uint64_t ns;
+  syscall1 (SYS_TIME_NS, &ns);
+  return ns;
+}
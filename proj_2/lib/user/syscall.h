@@ -2,7 +2,9 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <debug.h>
+#include <block-stats.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +47,8 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Diagnostics. */
+bool block_stats (int role, struct block_stats *);
+uint64_t time_ns (void);
+
 #endif /* lib/user/syscall.h */
@@ -22,6 +22,7 @@
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -34,8 +35,10 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/journal.h"
 #endif
 #ifdef VM
 #include "vm/frame.h"
@@ -49,6 +52,13 @@ uint32_t *init_page_dir;
 /* -f: Format the file system? */
 static bool format_filesys;
 
+/* -journal: Size of the journal made by -f, in sectors. */
+static block_sector_t journal_size = JOURNAL_DEFAULT_SIZE;
+
+/* -ramdisk: Size of the RAM disk "ram0", in sectors, or 0 for
+   none. */
+static block_sector_t ramdisk_size;
+
 /* -filesys, -scratch, -swap: Names of block devices to use,
    overriding the defaults. */
 static const char *filesys_bdev_name;
@@ -127,8 +137,10 @@ main (void)
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  if (ramdisk_size > 0)
+    ramdisk_init (ramdisk_size);
   locate_block_devices ();
-  filesys_init (format_filesys);
+  filesys_init (format_filesys, journal_size);
 #endif
 
 #ifdef VM
@@ -252,6 +264,10 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-journal"))
+        journal_size = atoi (value);
+      else if (!strcmp (name, "-ramdisk"))
+        ramdisk_size = atoi (value);
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
@@ -265,6 +281,10 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-debugcon"))
+        serial_use_debugcon ();
+      else if (!strcmp (name, "-trace"))
+        trace_print = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -380,6 +400,8 @@ usage (void)
           "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
           "  -f                 Format file system device during startup.\n"
+          "  -journal=SECTORS   Give -f a journal of SECTORS (0 for none).\n"
+          "  -ramdisk=SECTORS   Create RAM disk ram0 with SECTORS sectors.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
@@ -388,6 +410,8 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -debugcon          Write output to emulator debug port 0xe9.\n"
+          "  -trace             Print scheduling and I/O trace at shutdown.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -410,7 +434,9 @@ locate_block_devices (void)
 /* Figures out what block device to use for the given ROLE: the
    block device with the given NAME, if NAME is non-null,
    otherwise the first block device in probe order of type
-   ROLE. */
+   ROLE.  For swap, a device whose I/O does not queue behind the
+   file system device's, such as one on the other IDE channel, is
+   preferred over an earlier one that does. */
 static void
 locate_block_device (enum block_type role, const char *name)
 {
@@ -424,9 +450,21 @@ locate_block_device (enum block_type role, const char *name)
     }
   else
     {
-      for (block = block_first (); block != NULL; block = block_next (block))
-        if (block_type (block) == role)
-          break;
+      struct block *filesys = block_get_role (BLOCK_FILESYS);
+      struct block *b;
+
+      for (b = block_first (); b != NULL; b = block_next (b))
+        if (block_type (b) == role)
+          {
+            if (block == NULL)
+              block = b;
+            if (role != BLOCK_SWAP || filesys == NULL
+                || !block_shares_dispatcher (b, filesys))
+              {
+                block = b;
+                break;
+              }
+          }
     }
 
   if (block != NULL)
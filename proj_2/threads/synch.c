@@ -31,6 +31,32 @@
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#ifdef LOCK_PROFILE
+#include "devices/timer.h"
+
+/* Contention statistics for the locks of one name.  Locks that
+   share a name, such as the locks of all the malloc() arenas,
+   share statistics.  Times are in time stamp counter cycles. */
+struct lock_profile
+  {
+    const char *name;           /* Name given to lock_set_name(). */
+    uint64_t acquires;          /* Number of acquisitions. */
+    uint64_t contended;         /* Acquisitions that had to wait. */
+    uint64_t wait_time;         /* Total time spent waiting. */
+    uint64_t max_wait;          /* Longest wait. */
+    uint64_t hold_time;         /* Total time held. */
+    uint64_t max_hold;          /* Longest hold. */
+  };
+
+/* Profiles of all the names given so far. */
+#define LOCK_PROFILE_CNT 32
+static struct lock_profile profiles[LOCK_PROFILE_CNT];
+static size_t profile_cnt;
+
+static void profile_acquire (struct lock *, bool contended, uint64_t start);
+static void profile_release (struct lock *);
+#endif
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -179,6 +205,9 @@ lock_init (struct lock *lock)
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+#ifdef LOCK_PROFILE
+  lock->profile = NULL;
+#endif
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -196,8 +225,19 @@ lock_acquire (struct lock *lock)
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
+#ifdef LOCK_PROFILE
+  uint64_t start = timer_cycles ();
+#endif
+  bool contended = lock->semaphore.value == 0;
+
+  if (contended)
+    trace_record (TRACE_LOCK_CONTEND, thread_tid (), (uintptr_t) lock);
   sema_down (&lock->semaphore);
   lock->holder = thread_current ();
+  trace_record (TRACE_LOCK_ACQUIRE, thread_tid (), (uintptr_t) lock);
+#ifdef LOCK_PROFILE
+  profile_acquire (lock, contended, start);
+#endif
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -216,7 +256,13 @@ lock_try_acquire (struct lock *lock)
 
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->holder = thread_current ();
+      trace_record (TRACE_LOCK_ACQUIRE, thread_tid (), (uintptr_t) lock);
+#ifdef LOCK_PROFILE
+      profile_acquire (lock, false, timer_cycles ());
+#endif
+    }
   return success;
 }
 
@@ -231,6 +277,10 @@ lock_release (struct lock *lock)
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  trace_record (TRACE_LOCK_RELEASE, thread_tid (), (uintptr_t) lock);
+#ifdef LOCK_PROFILE
+  profile_release (lock);
+#endif
   lock->holder = NULL;
   sema_up (&lock->semaphore);
 }
@@ -246,6 +296,109 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
+#ifdef LOCK_PROFILE
+/* Names LOCK, so that its contention statistics are kept and
+   reported by lock_print_stats(), together with those of any
+   other locks of the same NAME.  NAME must remain valid as long
+   as the kernel runs; a string literal is best.  If too many
+   names are in use already, LOCK is not profiled. */
+void
+lock_set_name (struct lock *lock, const char *name)
+{
+  enum intr_level old_level;
+  size_t i;
+
+  ASSERT (lock != NULL);
+  ASSERT (name != NULL);
+
+  old_level = intr_disable ();
+  for (i = 0; i < profile_cnt; i++)
+    if (!strcmp (profiles[i].name, name))
+      break;
+  if (i == profile_cnt && profile_cnt < LOCK_PROFILE_CNT)
+    profiles[profile_cnt++].name = name;
+  lock->profile = i < profile_cnt ? &profiles[i] : NULL;
+  intr_set_level (old_level);
+}
+
+/* Prints the statistics of each lock name that has been
+   acquired, most total waiting first. */
+void
+lock_print_stats (void)
+{
+  struct lock_profile *sorted[LOCK_PROFILE_CNT];
+  size_t cnt = 0;
+  size_t i, j;
+
+  for (i = 0; i < profile_cnt; i++)
+    if (profiles[i].acquires > 0)
+      {
+        /* Insertion sort. */
+        j = cnt++;
+        while (j > 0 && sorted[j - 1]->wait_time < profiles[i].wait_time)
+          {
+            sorted[j] = sorted[j - 1];
+            j--;
+          }
+        sorted[j] = &profiles[i];
+      }
+
+  for (i = 0; i < cnt; i++)
+    {
+      const struct lock_profile *p = sorted[i];
+      printf ("Lock %s: %llu acquires, %llu contended, "
+              "wait %llu cycles (max %llu), hold %llu cycles (max %llu)\n",
+              p->name, p->acquires, p->contended,
+              p->wait_time, p->max_wait, p->hold_time, p->max_hold);
+    }
+}
+
+/* Records that LOCK has just been acquired, after waiting since
+   START if CONTENDED. */
+static void
+profile_acquire (struct lock *lock, bool contended, uint64_t start)
+{
+  struct lock_profile *p = lock->profile;
+  enum intr_level old_level;
+  uint64_t wait;
+
+  lock->acquire_time = timer_cycles ();
+  if (p == NULL)
+    return;
+
+  wait = lock->acquire_time - start;
+  old_level = intr_disable ();
+  p->acquires++;
+  if (contended)
+    {
+      p->contended++;
+      p->wait_time += wait;
+      if (wait > p->max_wait)
+        p->max_wait = wait;
+    }
+  intr_set_level (old_level);
+}
+
+/* Records that LOCK is about to be released. */
+static void
+profile_release (struct lock *lock)
+{
+  struct lock_profile *p = lock->profile;
+  enum intr_level old_level;
+  uint64_t hold;
+
+  if (p == NULL)
+    return;
+
+  hold = timer_cycles () - lock->acquire_time;
+  old_level = intr_disable ();
+  p->hold_time += hold;
+  if (hold > p->max_hold)
+    p->max_hold = hold;
+  intr_set_level (old_level);
+}
+#endif /* LOCK_PROFILE */
+
 /* One semaphore in a list. */
 struct semaphore_elem 
   {
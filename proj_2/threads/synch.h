@@ -1,8 +1,10 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <debug.h>
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* A counting semaphore. */
 struct semaphore 
@@ -22,6 +24,10 @@ struct lock
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+#ifdef LOCK_PROFILE
+    struct lock_profile *profile; /* Statistics, or null if unnamed. */
+    uint64_t acquire_time;      /* When HOLDER acquired it, in cycles. */
+#endif
   };
 
 void lock_init (struct lock *);
@@ -30,6 +36,24 @@ bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
 
+/* Lock contention profiling, enabled by building with
+   "make LOCK_PROFILE=1".  Otherwise these do nothing and locks
+   carry no statistics. */
+#ifdef LOCK_PROFILE
+void lock_set_name (struct lock *, const char *name);
+void lock_print_stats (void);
+#else
+static inline void
+lock_set_name (struct lock *lock UNUSED, const char *name UNUSED)
+{
+}
+
+static inline void
+lock_print_stats (void)
+{
+}
+#endif
+
 /* Condition variable. */
 struct condition 
   {
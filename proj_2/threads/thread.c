@@ -13,6 +13,7 @@
 #include "threads/malloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "vm/page.h"
 
@@ -91,6 +92,7 @@ thread_init (void)
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
+  lock_set_name (&tid_lock, "tid");
   list_init (&ready_list);
   list_init (&all_list);
 
@@ -99,6 +101,7 @@ thread_init (void)
   init_thread (initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
+  trace_name (initial_thread->tid, initial_thread->name);
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -183,6 +186,7 @@ thread_create (const char *name, int priority,
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+  trace_name (tid, t->name);
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -236,6 +240,7 @@ thread_block (void)
   ASSERT (intr_get_level () == INTR_OFF);
 
   thread_current ()->status = THREAD_BLOCKED;
+  trace_record (TRACE_BLOCK, thread_current ()->tid, 0);
   schedule ();
 }
 
@@ -258,6 +263,7 @@ thread_unblock (struct thread *t)
   ASSERT (t->status == THREAD_BLOCKED);
   list_push_back (&ready_list, &t->elem);
   t->status = THREAD_READY;
+  trace_record (TRACE_UNBLOCK, running_thread ()->tid, t->tid);
   intr_set_level (old_level);
 }
 
@@ -387,6 +393,7 @@ void
 thread_set_priority (int new_priority) 
 {
   thread_current ()->priority = new_priority;
+  trace_record (TRACE_PRIORITY, thread_tid (), new_priority);
 }
 
 /* Returns the current thread's priority. */
@@ -618,7 +625,10 @@ schedule (void)
   ASSERT (is_thread (next));
 
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      trace_record (TRACE_SWITCH, cur->tid, next->tid);
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
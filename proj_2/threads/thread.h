@@ -126,6 +126,12 @@ struct thread
     struct file *self_file_executable;  /* File pointer to open exectuable. */
 #endif
 
+#ifdef FILESYS
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Nesting of journal_begin(). */
+    size_t journal_reserved;            /* Sectors reserved by it. */
+#endif
+
 #ifdef VM
     struct hash spt;
     struct list mmap_list;             /* List of memory mapped files. */
@@ -0,0 +1,117 @@
+#include "threads/trace.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+
+/* Event tracer.
+
+   Scheduling, locking, priority changes, page faults, and block
+   I/O record timestamped events in a ring buffer that holds the
+   most recent TRACE_EVENTS of them.  Recording an event costs a
+   read of the time stamp counter and a few stores with
+   interrupts off, so it is always on.  With the "-trace" option,
+   the buffer is printed at shutdown, one event per line, for
+   utils/pintos-trace to turn into a timeline that a trace viewer
+   can display. */
+
+/* Number of events kept. */
+#define TRACE_EVENTS 4096
+
+/* A recorded event. */
+struct trace_event
+  {
+    uint64_t cycles;            /* Time stamp counter. */
+    tid_t tid;                  /* Thread it concerns. */
+    uint32_t arg;               /* Depends on TYPE. */
+    uint8_t type;               /* An enum trace_type. */
+  };
+
+static struct trace_event events[TRACE_EVENTS];
+static uint64_t event_cnt;      /* Events recorded, including lost. */
+static bool printing;           /* Stop recording while printing. */
+
+/* Names of the most recently created threads, indexed by tid
+   modulo TRACE_NAMES, so that the trace can name threads that
+   have since exited. */
+#define TRACE_NAMES 128
+struct trace_thread
+  {
+    tid_t tid;
+    char name[16];
+  };
+static struct trace_thread threads[TRACE_NAMES];
+
+static const char *type_names[TRACE_TYPE_CNT] =
+  {
+    "switch", "block", "unblock",
+    "lock-contend", "lock-acquire", "lock-release",
+    "fault-begin", "fault-end", "io-begin", "io-end", "priority",
+  };
+
+/* If true, print the trace at shutdown. */
+bool trace_print;
+
+/* Records an event of kind TYPE for thread TID with argument ARG,
+   overwriting the oldest event if the buffer is full.  May be
+   called from any context, including interrupt handlers. */
+void
+trace_record (enum trace_type type, tid_t tid, uint32_t arg)
+{
+  struct trace_event *e;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (printing)
+    {
+      intr_set_level (old_level);
+      return;
+    }
+  e = &events[event_cnt++ % TRACE_EVENTS];
+  e->cycles = timer_cycles ();
+  e->tid = tid;
+  e->arg = arg;
+  e->type = type;
+  intr_set_level (old_level);
+}
+
+/* Remembers NAME as the name of thread TID. */
+void
+trace_name (tid_t tid, const char *name)
+{
+  struct trace_thread *t = &threads[tid % TRACE_NAMES];
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  t->tid = tid;
+  strlcpy (t->name, name, sizeof t->name);
+  intr_set_level (old_level);
+}
+
+/* Prints the recorded events, oldest first, with times in
+   nanoseconds since boot, and the names of the threads. */
+void
+trace_print_events (void)
+{
+  uint64_t first, i;
+  int j;
+
+  /* Printing takes the console lock, which would otherwise
+     record events over those not yet printed. */
+  printing = true;
+  first = event_cnt > TRACE_EVENTS ? event_cnt - TRACE_EVENTS : 0;
+  printf ("trace: %"PRIu64" events, %"PRIu64" lost\n",
+          event_cnt - first, first);
+  for (j = 0; j < TRACE_NAMES; j++)
+    if (threads[j].name[0] != '\0')
+      printf ("trace: thread %d %s\n", threads[j].tid, threads[j].name);
+  for (i = first; i < event_cnt; i++)
+    {
+      const struct trace_event *e = &events[i % TRACE_EVENTS];
+      printf ("trace: %"PRIu64" %d %s %#"PRIx32"\n",
+              timer_cycles_to_ns (e->cycles), e->tid,
+              type_names[e->type], e->arg);
+    }
+  printf ("trace: end\n");
+}
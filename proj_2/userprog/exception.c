@@ -7,6 +7,7 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "vm/frame.h"
 
@@ -140,6 +141,7 @@ page_fault (struct intr_frame *f)
   bool not_present;  /* True: not-present page, false: writing r/o page. */
   bool user;         /* True: access by user, false: access by kernel. */
   void *fault_addr;  /* Fault address. */
+  bool handled;      /* True: page brought in, so resume. */
 
   /* Obtain faulting address, the virtual address that was
      accessed to cause the fault.  It may point to code or to
@@ -163,23 +165,26 @@ page_fault (struct intr_frame *f)
   not_present = (f->error_code & PF_P) == 0;
   user = (f->error_code & PF_U) != 0;
 
+  trace_record (TRACE_FAULT_BEGIN, thread_tid (), (uintptr_t) fault_addr);
+  handled = false;
   if (not_present)
     {
       /* Tries to page in */
       void *upage = pg_round_down (fault_addr);
-      if (vm_page_in (upage)) return;
+      handled = vm_page_in (upage);
     }
 
-  if (user && fault_addr < PHYS_BASE &&
+  if (!handled && user && fault_addr < PHYS_BASE &&
               (fault_addr == f->esp - 4 
                || fault_addr == f->esp - 32
                || fault_addr >= f->esp)) 
     {
       /* Tries to add a stack page */
-      if (vm_add_stack_page ()) return;
+      handled = vm_add_stack_page ();
     }
+  trace_record (TRACE_FAULT_END, thread_tid (), (uintptr_t) fault_addr);
 
-
-  kill (f);
+  if (!handled)
+    kill (f);
 }
 
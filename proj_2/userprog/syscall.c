@@ -12,7 +12,9 @@
 #include "threads/pte.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "devices/block.h"
 #include "devices/shutdown.h"
+#include "devices/timer.h"
 #include "devices/input.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
@@ -51,6 +53,8 @@ unsigned tell (int fd);
 void close (int fd);
 mapid_t mmap (int fd, void *addr);
 void munmap (mapid_t mapping);
+bool block_stats (int role, struct block_stats *stats);
+void time_ns (uint64_t *ns);
 
 void
 syscall_init (void) 
@@ -140,6 +144,16 @@ call_syscall (struct intr_frame *f, int syscall)
         mapid_t mapping = * (mapid_t *) get_nth_syscall_arg (f->esp, 1);
         munmap (mapping);
         break;
+      case SYS_BLOCK_STATS : ;
+        int role = * (int *) get_nth_syscall_arg (f->esp, 1);
+        struct block_stats *stats
+          = * (struct block_stats **) get_nth_syscall_arg (f->esp, 2);
+        f->eax = block_stats (role, stats);
+        break;
+      case SYS_TIME_NS : ;
+        uint64_t *ns = * (uint64_t **) get_nth_syscall_arg (f->esp, 1);
+        time_ns (ns);
+        break;
       default : ;
         exit (-1);
     }
@@ -523,6 +537,35 @@ munmap (mapid_t mapping)
   free (mf);
 }
 
+bool
+block_stats (int role, struct block_stats *stats)
+{
+  struct block_stats copy;
+
+  if (!is_valid_memory_range (stats, sizeof *stats, true))
+    exit (-1);
+  if (role < 0 || !block_get_stats (role, &copy))
+    return false;
+
+  vm_pin_buffer_frames (stats, sizeof *stats);
+  *stats = copy;
+  vm_unpin_buffer_frames (stats, sizeof *stats);
+  return true;
+}
+
+void
+time_ns (uint64_t *ns)
+{
+  uint64_t now = timer_ns ();
+
+  if (!is_valid_memory_range (ns, sizeof *ns, true))
+    exit (-1);
+
+  vm_pin_buffer_frames (ns, sizeof *ns);
+  *ns = now;
+  vm_unpin_buffer_frames (ns, sizeof *ns);
+}
+
 /* Determines whether the supplied pointer references a valid string. */
 static bool
 is_valid_string_memory (const void *vaddr) 
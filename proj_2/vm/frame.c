@@ -34,6 +34,7 @@ ft_init (void)
 {
   list_init (&frame_table);
   lock_init (&frame_table_lock);
+  lock_set_name (&frame_table_lock, "frame table");
   clock_hand = NULL;
 }
 
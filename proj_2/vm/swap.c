@@ -21,6 +21,7 @@ swap_init (void)
     PANIC ("Cannot initialize swap partition.");
 
   lock_init (&swap_lock);
+  lock_set_name (&swap_lock, "swap");
 }
 
 /**
@@ -29,12 +30,8 @@ swap_init (void)
 void
 swap_read (void *vaddr, block_sector_t start_sector)
 {
-  for (int i = 0; i < NUM_BLOCKS_IN_PAGE; i++)
-    {
-        block_read (swap_partition, 
-                    start_sector + i, 
-                    (char *)vaddr + i * BLOCK_SECTOR_SIZE);
-    }
+  block_read_multiple (swap_partition, start_sector, NUM_BLOCKS_IN_PAGE,
+                       vaddr);
 
   lock_acquire (&swap_lock);
   bitmap_set_multiple (swap_table, start_sector, NUM_BLOCKS_IN_PAGE, false);
@@ -58,12 +55,8 @@ swap_write (void *vaddr)
   if (start_sector == BITMAP_ERROR)
     PANIC ("Swap partition is full");
 
-  for (int i = 0; i < NUM_BLOCKS_IN_PAGE; i++)
-    {
-        block_write (swap_partition, 
-                    start_sector + i, 
-                    (char *)vaddr + i * BLOCK_SECTOR_SIZE);
-    }
+  block_write_multiple (swap_partition, start_sector, NUM_BLOCKS_IN_PAGE,
+                        vaddr);
 
   return start_sector;
 }
@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -81,3 +78,60 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Starts the given CHANNEL counting down COUNT PIT cycles, once,
+   in mode 0.  Its output drops to 0 and rises back to 1 when the
+   count runs out, which for channel 0 raises interrupt line 0.
+   COUNT must be between 1 and 65535. */
+void
+pit_start_countdown (int channel, unsigned count)
+{
+  enum intr_level old_level;
+
+  ASSERT (channel == 0 || channel == 2);
+  ASSERT (count >= 1 && count <= 0xffff);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, (channel << 6) | 0x30);
+  outb (PIT_PORT_COUNTER (channel), count);
+  outb (PIT_PORT_COUNTER (channel), count >> 8);
+  intr_set_level (old_level);
+}
+
+/* Returns the value of the given CHANNEL's counter, which is the
+   number of PIT cycles left in its current count. */
+unsigned
+pit_read_count (int channel)
+{
+  enum intr_level old_level;
+  unsigned count;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  /* Latch the counter, then read it low byte first. */
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, channel << 6);
+  count = inb (PIT_PORT_COUNTER (channel));
+  count |= inb (PIT_PORT_COUNTER (channel)) << 8;
+  intr_set_level (old_level);
+
+  return count;
+}
+
+/* Returns the state of the given CHANNEL's output. */
+bool
+pit_read_output (int channel)
+{
+  enum intr_level old_level;
+  uint8_t status;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  /* Latch the channel's status with a read-back command. */
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, 0xe0 | (2 << channel));
+  status = inb (PIT_PORT_COUNTER (channel));
+  intr_set_level (old_level);
+
+  return (status & 0x80) != 0;
+}
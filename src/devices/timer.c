@@ -20,34 +20,90 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
-/* List containing sleeping threads */
-static struct list sleep_list;
+/* Sleeping threads are kept in a hierarchical timing wheel, so
+   that putting a thread to sleep and waking it take constant
+   time however many threads are asleep.
+
+   Level 0 has a slot for each of the next WHEEL_SLOTS ticks.
+   Each slot of level 1 covers WHEEL_SLOTS ticks, each slot of
+   level 2 covers WHEEL_SLOTS level-1 slots, and so on.  A
+   thread is filed in the lowest level that reaches its wake-up
+   tick, in the slot that the tick's bits select.  As time
+   reaches a higher-level slot, its threads are cascaded down to
+   the level below, so the timer interrupt only ever wakes the
+   threads in the current level-0 slot. */
+#define WHEEL_BITS 6                            /* Bits per level. */
+#define WHEEL_SLOTS (1 << WHEEL_BITS)           /* Slots per level. */
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4                          /* Number of levels. */
+
+/* Lists of sleeping threads, by level and slot. */
+static struct list wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+
+/* Next tick whose sleeping threads have not been woken. */
+static int64_t wheel_ticks;
+
+/* If true, the timer stops ticking periodically while the CPU is
+   idle.  Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* PIT cycles per timer tick. */
+#define TICK_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* While the CPU idles in tickless mode, the PIT counts down once
+   to the next tick that has work to do instead of interrupting at
+   every tick.  These describe that countdown.  ONESHOT_TICKS is 0
+   while the timer ticks periodically. */
+static int64_t oneshot_ticks;           /* Ticks the countdown spans. */
+static unsigned oneshot_first;          /* Cycles to its first tick. */
+static unsigned oneshot_cycles;         /* Cycles it counts in all. */
 
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Number of timer ticks over which the time stamp counter is
+   measured by timer_calibrate(). */
+#define TSC_CALIBRATE_TICKS 4
+
+/* Time stamp counter when the timer was initialized. */
+static uint64_t boot_cycles;
+
+/* Time stamp counter cycles per second.
+   Initialized by timer_calibrate(). */
+static uint64_t cycles_per_sec;
+
 static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
-bool list_less (const struct list_elem *a,
-                const struct list_elem *b,
-                void *aux);
-
+static void wheel_insert (struct thread *, bool front);
+static void wheel_cascade (int level);
+static bool tick_has_work (int64_t tick, int64_t next_event);
+static void start_oneshot (void);
+static int64_t end_oneshot (void);
+static void skip_ticks (int64_t);
+static void calibrate_cycles (void);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
 timer_init (void) 
 {
+  int level, slot;
+
+  boot_cycles = timer_cycles ();
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
-  list_init (&sleep_list);
+
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    for (slot = 0; slot < WHEEL_SLOTS; slot++)
+      list_init (&wheel[level][slot]);
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates loops_per_tick, used to implement brief delays, and
+   the rate of the time stamp counter, used by timer_ns(). */
 void
 timer_calibrate (void) 
 {
@@ -71,7 +127,44 @@ timer_calibrate (void)
     if (!too_many_loops (loops_per_tick | test_bit))
       loops_per_tick |= test_bit;
 
-  printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+  printf ("%'"PRIu64" loops/s", (uint64_t) loops_per_tick * TIMER_FREQ);
+
+  calibrate_cycles ();
+  printf (", %'"PRIu64" cycles/s.\n", cycles_per_sec);
+}
+
+/* Returns the time stamp counter, which counts CPU cycles. */
+uint64_t
+timer_cycles (void)
+{
+  uint64_t cycles;
+  asm volatile ("rdtsc" : "=A" (cycles));
+  return cycles;
+}
+
+/* Returns the number of nanoseconds since the OS booted, as
+   measured by the time stamp counter, or 0 if the timer has not
+   been calibrated yet. */
+uint64_t
+timer_ns (void)
+{
+  return timer_cycles_to_ns (timer_cycles ());
+}
+
+/* Converts CYCLES, a reading of timer_cycles(), to nanoseconds
+   since the OS booted.  Returns 0 if the timer has not been
+   calibrated yet or CYCLES is from before boot. */
+uint64_t
+timer_cycles_to_ns (uint64_t cycles)
+{
+  if (cycles_per_sec == 0 || cycles < boot_cycles)
+    return 0;
+  cycles -= boot_cycles;
+
+  /* Convert whole seconds separately, so that the product
+     cannot overflow. */
+  return (cycles / cycles_per_sec * 1000000000
+          + cycles % cycles_per_sec * 1000000000 / cycles_per_sec);
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -104,10 +197,7 @@ timer_sleep (int64_t ticks)
   /* Disables interrupts (required for thread_block call). */ 
   intr_disable ();
 
-  list_insert_ordered (&sleep_list,
-                       &(current_thread->sleep_elem),
-                       list_less,
-                       NULL);
+  wheel_insert (current_thread, false);
 
   thread_block ();
   /* Thread_block returns when the sleep time ends 
@@ -115,18 +205,178 @@ timer_sleep (int64_t ticks)
   intr_enable ();
 }
 
-/* Comparison function for list insert. */
-bool list_less (const struct list_elem *a,
-                const struct list_elem *b,
-                void *aux)
+/* Files sleeping thread T in the timing wheel slot for its
+   wake-up tick, at the front of the slot if FRONT is true or at
+   the back otherwise.  Interrupts must be off. */
+static void
+wheel_insert (struct thread *t, bool front)
+{
+  int64_t delta = t->sleep_until - wheel_ticks;
+  int64_t when = t->sleep_until;
+  struct list *slot;
+  int level;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* A thread whose tick has passed wakes at the next one.  One
+     that sleeps past the top level's reach is filed as far out
+     as it goes and cascaded back up to the top when it gets
+     there. */
+  if (delta < 0)
+    when = wheel_ticks;
+  else if (delta >= (int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS))
+    when = wheel_ticks + ((int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+
+  for (level = 0; level < WHEEL_LEVELS - 1; level++)
+    if (when - wheel_ticks < (int64_t) 1 << (WHEEL_BITS * (level + 1)))
+      break;
+  slot = &wheel[level][(when >> (WHEEL_BITS * level)) & WHEEL_MASK];
+
+  if (front)
+    list_push_front (slot, &t->sleep_elem);
+  else
+    list_push_back (slot, &t->sleep_elem);
+}
+
+/* Moves the threads in the current slot of LEVEL down to the
+   levels below.  If that slot is the level's first, the next
+   level up is cascaded first.  Interrupts must be off. */
+static void
+wheel_cascade (int level)
+{
+  int index = (wheel_ticks >> (WHEEL_BITS * level)) & WHEEL_MASK;
+  struct list *slot = &wheel[level][index];
+
+  if (index == 0 && level + 1 < WHEEL_LEVELS)
+    wheel_cascade (level + 1);
+
+  /* Threads here went to sleep before any thread already filed
+     below for the same tick, so they go in front, in their
+     original order, to keep wake-ups first come, first served. */
+  while (!list_empty (slot))
+    {
+      struct list_elem *e = list_pop_back (slot);
+      wheel_insert (list_entry (e, struct thread, sleep_elem), true);
+    }
+}
+
+
+/* Waits for the next interrupt with the CPU idle.  Interrupts
+   must be off on entry; they are on when this function returns.
+
+   In tickless mode, the periodic tick stops until the next tick
+   that has a thread to wake or scheduler work to do, or as long
+   as the PIT's 16-bit counter can wait, whichever comes first.
+   Any interrupt ends the wait, and TICKS catches up with the
+   time that has passed. */
+void
+timer_idle (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (timer_tickless)
+    start_oneshot ();
+
+  /* Re-enable interrupts and wait for the next one.
+
+     The `sti' instruction disables interrupts until the
+     completion of the next instruction, so these two
+     instructions are executed atomically.  This atomicity is
+     important; otherwise, an interrupt could be handled
+     between re-enabling interrupts and waiting for the next
+     one to occur, wasting as much as one clock tick worth of
+     time.
+
+     See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
+     7.11.1 "HLT Instruction". */
+  asm volatile ("sti; hlt" : : : "memory");
+
+  /* Another interrupt woke us before the countdown ran out.
+     Once the countdown has run out, its interrupt is pending and
+     the timer interrupt handler does the catching up. */
+  if (timer_tickless)
+    {
+      intr_disable ();
+      if (oneshot_ticks != 0 && !pit_read_output (0))
+        skip_ticks (end_oneshot ());
+      intr_enable ();
+    }
+}
+
+/* Returns true if timer tick TICK has threads to wake, a level of
+   the timing wheel to cascade, or NEXT_EVENT, the next tick with
+   scheduler work, has arrived by then. */
+static bool
+tick_has_work (int64_t tick, int64_t next_event)
+{
+  return (tick >= next_event
+          || (tick & WHEEL_MASK) == 0
+          || !list_empty (&wheel[0][tick & WHEEL_MASK]));
+}
+
+/* Replaces the periodic tick by a single countdown to the next
+   tick that has work to do, if that is more than one tick away.
+   Interrupts must be off. */
+static void
+start_oneshot (void)
 {
-  (void) aux;
-  struct thread *a_entry = list_entry (a, struct thread, sleep_elem);
-  struct thread *b_entry = list_entry (b, struct thread, sleep_elem);
-  return a_entry->sleep_until < b_entry->sleep_until;
+  int64_t next_event = thread_next_event (ticks);
+  unsigned first = pit_read_count (0);
+  int64_t span;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (oneshot_ticks == 0);
+
+  /* The current period ends at tick TICKS + 1.  Extend the wait
+     one period at a time while the next tick has nothing to do
+     and the count still fits the counter. */
+  for (span = 1; first + span * TICK_CYCLES <= 0xffff; span++)
+    if (tick_has_work (ticks + span, next_event))
+      break;
+  if (span <= 1)
+    return;
+
+  oneshot_ticks = span;
+  oneshot_first = first;
+  oneshot_cycles = first + (span - 1) * TICK_CYCLES;
+  pit_start_countdown (0, oneshot_cycles);
 }
 
+/* Ends the countdown started by start_oneshot(), resumes the
+   periodic tick, and returns the number of tick boundaries that
+   passed during the countdown.  The part of a tick that had
+   passed when the countdown ended is lost.  Interrupts must be
+   off. */
+static int64_t
+end_oneshot (void)
+{
+  int64_t passed;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (oneshot_ticks != 0);
+
+  if (pit_read_output (0))
+    passed = oneshot_ticks;
+  else
+    {
+      unsigned elapsed = oneshot_cycles - pit_read_count (0);
+      passed = (elapsed < oneshot_first ? 0
+                : 1 + (elapsed - oneshot_first) / TICK_CYCLES);
+    }
+
+  oneshot_ticks = 0;
+  pit_configure_channel (0, 2, TIMER_FREQ);
+  return passed;
+}
 
+/* Advances TICKS by SKIPPED ticks that passed, with the CPU
+   idle, without a timer interrupt. */
+static void
+skip_ticks (int64_t skipped)
+{
+  ticks += skipped;
+  thread_account_idle (skipped);
+}
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
    turned on. */
@@ -202,21 +452,57 @@ timer_print_stats (void)
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
+  /* This interrupt marks the last tick boundary that a countdown
+     crossed, or a periodic tick that was pending when it
+     started. */
+  if (oneshot_ticks != 0)
+    {
+      int64_t passed = end_oneshot ();
+      if (passed > 1)
+        skip_ticks (passed - 1);
+    }
+
   ticks++;
 
-  /* Unblocks all threads whose sleep time has ended */
-  while (!list_empty (&sleep_list) 
-          && (list_entry (list_front (&sleep_list), struct thread, sleep_elem)
-              ->sleep_until <= timer_ticks ()))
+  /* Unblocks all threads whose sleep time has ended. */
+  while (wheel_ticks <= ticks)
     {
-      struct list_elem *head = list_pop_front (&sleep_list);
-      struct thread *next_thread = list_entry (head, struct thread, sleep_elem);
-      thread_unblock (next_thread);
+      struct list *slot = &wheel[0][wheel_ticks & WHEEL_MASK];
+
+      if ((wheel_ticks & WHEEL_MASK) == 0)
+        wheel_cascade (1);
+      while (!list_empty (slot))
+        {
+          struct list_elem *e = list_pop_front (slot);
+          thread_unblock (list_entry (e, struct thread, sleep_elem));
+        }
+      wheel_ticks++;
     }
   
   thread_tick ();
 }
 
+/* Measures cycles_per_sec by counting time stamp counter cycles
+   across TSC_CALIBRATE_TICKS timer ticks. */
+static void
+calibrate_cycles (void)
+{
+  int64_t start;
+  uint64_t start_cycles;
+
+  /* Start at a timer tick. */
+  start = ticks;
+  while (ticks == start)
+    barrier ();
+
+  start = ticks;
+  start_cycles = timer_cycles ();
+  while (ticks - start < TSC_CALIBRATE_TICKS)
+    barrier ();
+  cycles_per_sec = ((timer_cycles () - start_cycles) * TIMER_FREQ
+                    / TSC_CALIBRATE_TICKS);
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool
@@ -2,17 +2,27 @@
 #define DEVICES_TIMER_H
 
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* If true, the timer stops ticking periodically while the CPU is
+   idle.  Controlled by kernel command-line option "-tickless". */
+extern bool timer_tickless;
+
 void timer_init (void);
 void timer_calibrate (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
 
+/* High-resolution clock. */
+uint64_t timer_cycles (void);
+uint64_t timer_ns (void);
+uint64_t timer_cycles_to_ns (uint64_t cycles);
+
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
 void timer_msleep (int64_t milliseconds);
@@ -24,6 +34,9 @@ void timer_mdelay (int64_t milliseconds);
 void timer_udelay (int64_t microseconds);
 void timer_ndelay (int64_t nanoseconds);
 
+/* Idling. */
+void timer_idle (void);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
@@ -0,0 +1,201 @@
+/* Balanced binary search tree.
+
+   See avl.h for basic information. */
+
+#include "avl.h"
+#include "../debug.h"
+
+static struct avl_elem *insert_elem (struct avl *, struct avl_elem *node,
+                                     struct avl_elem *);
+static struct avl_elem *remove_elem (struct avl *, struct avl_elem *node,
+                                     struct avl_elem *);
+static struct avl_elem *remove_min (struct avl_elem *node,
+                                    struct avl_elem **min);
+static struct avl_elem *rebalance (struct avl_elem *);
+static struct avl_elem *rotate_left (struct avl_elem *);
+static struct avl_elem *rotate_right (struct avl_elem *);
+static void update_height (struct avl_elem *);
+static int height (const struct avl_elem *);
+
+/* Initializes TREE as an empty tree that compares elements using
+   LESS, given auxiliary data AUX. */
+void
+avl_init (struct avl *tree, avl_less_func *less, void *aux)
+{
+  tree->root = NULL;
+  tree->elem_cnt = 0;
+  tree->less = less;
+  tree->aux = aux;
+}
+
+/* Inserts NEW into TREE. */
+void
+avl_insert (struct avl *tree, struct avl_elem *new)
+{
+  new->left = new->right = NULL;
+  new->height = 1;
+  tree->root = insert_elem (tree, tree->root, new);
+  tree->elem_cnt++;
+}
+
+/* Removes E, which must be in TREE, from TREE. */
+void
+avl_remove (struct avl *tree, struct avl_elem *e)
+{
+  ASSERT (tree->elem_cnt > 0);
+  tree->root = remove_elem (tree, tree->root, e);
+  tree->elem_cnt--;
+}
+
+/* Returns the least element in TREE, or a null pointer if TREE
+   is empty. */
+struct avl_elem *
+avl_min (const struct avl *tree)
+{
+  struct avl_elem *e = tree->root;
+
+  if (e != NULL)
+    while (e->left != NULL)
+      e = e->left;
+  return e;
+}
+
+/* Returns the number of elements in TREE. */
+size_t
+avl_size (const struct avl *tree)
+{
+  return tree->elem_cnt;
+}
+
+/* Returns true if TREE contains no elements, false otherwise. */
+bool
+avl_empty (const struct avl *tree)
+{
+  return tree->root == NULL;
+}
+
+/* Inserts NEW into the subtree rooted at NODE and returns the
+   subtree's new root. */
+static struct avl_elem *
+insert_elem (struct avl *tree, struct avl_elem *node, struct avl_elem *new)
+{
+  if (node == NULL)
+    return new;
+
+  if (tree->less (new, node, tree->aux))
+    node->left = insert_elem (tree, node->left, new);
+  else
+    node->right = insert_elem (tree, node->right, new);
+  return rebalance (node);
+}
+
+/* Removes E from the subtree rooted at NODE, which must contain
+   it, and returns the subtree's new root. */
+static struct avl_elem *
+remove_elem (struct avl *tree, struct avl_elem *node, struct avl_elem *e)
+{
+  ASSERT (node != NULL);
+
+  if (node == e)
+    {
+      struct avl_elem *min;
+
+      /* Replace E by the least element of its right subtree, if
+         it has one. */
+      if (e->right == NULL)
+        return e->left;
+      e->right = remove_min (e->right, &min);
+      min->left = e->left;
+      min->right = e->right;
+      return rebalance (min);
+    }
+
+  if (tree->less (e, node, tree->aux))
+    node->left = remove_elem (tree, node->left, e);
+  else
+    node->right = remove_elem (tree, node->right, e);
+  return rebalance (node);
+}
+
+/* Removes the least element from the subtree rooted at NODE,
+   stores it in *MIN, and returns the subtree's new root. */
+static struct avl_elem *
+remove_min (struct avl_elem *node, struct avl_elem **min)
+{
+  if (node->left == NULL)
+    {
+      *min = node;
+      return node->right;
+    }
+  node->left = remove_min (node->left, min);
+  return rebalance (node);
+}
+
+/* Restores the balance of NODE, whose subtrees are balanced and
+   differ in height by at most two, and returns the root of the
+   resulting subtree. */
+static struct avl_elem *
+rebalance (struct avl_elem *node)
+{
+  int balance = height (node->left) - height (node->right);
+
+  if (balance > 1)
+    {
+      if (height (node->left->left) < height (node->left->right))
+        node->left = rotate_left (node->left);
+      return rotate_right (node);
+    }
+  else if (balance < -1)
+    {
+      if (height (node->right->right) < height (node->right->left))
+        node->right = rotate_right (node->right);
+      return rotate_left (node);
+    }
+
+  update_height (node);
+  return node;
+}
+
+/* Rotates the subtree rooted at NODE to the left and returns its
+   new root, NODE's right child. */
+static struct avl_elem *
+rotate_left (struct avl_elem *node)
+{
+  struct avl_elem *right = node->right;
+
+  node->right = right->left;
+  right->left = node;
+  update_height (node);
+  update_height (right);
+  return right;
+}
+
+/* Rotates the subtree rooted at NODE to the right and returns
+   its new root, NODE's left child. */
+static struct avl_elem *
+rotate_right (struct avl_elem *node)
+{
+  struct avl_elem *left = node->left;
+
+  node->left = left->right;
+  left->right = node;
+  update_height (node);
+  update_height (left);
+  return left;
+}
+
+/* Recomputes the height of NODE from those of its children. */
+static void
+update_height (struct avl_elem *node)
+{
+  int l = height (node->left);
+  int r = height (node->right);
+  node->height = (l > r ? l : r) + 1;
+}
+
+/* Returns the height of the subtree rooted at NODE. */
+static int
+height (const struct avl_elem *node)
+{
+  return node != NULL ? node->height : 0;
+}
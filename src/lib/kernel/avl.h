@@ -0,0 +1,70 @@
+#ifndef __LIB_KERNEL_AVL_H
+#define __LIB_KERNEL_AVL_H
+
+/* Balanced binary search tree.
+
+   This is an AVL tree: the heights of the two subtrees of any
+   element differ by at most one, so a tree of N elements has
+   height O(log N) and insertion, deletion, and finding the
+   minimum all take O(log N) time.
+
+   Like lists and hash tables, trees do not use dynamic
+   allocation.  Each structure that can potentially be in a tree
+   must embed a struct avl_elem member, and the avl_entry macro
+   converts from a struct avl_elem back to the structure that
+   contains it.  Refer to lib/kernel/list.h for a detailed
+   explanation of the technique.
+
+   The comparison function must order all the elements in a tree
+   strictly: no two elements may compare equal.  Break ties by
+   some unique field if need be.  An element's key must not
+   change while it is in a tree. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+struct avl_elem
+  {
+    struct avl_elem *left;      /* Lesser elements. */
+    struct avl_elem *right;     /* Greater elements. */
+    int height;                 /* Height of subtree rooted here. */
+  };
+
+/* Converts pointer to tree element AVL_ELEM into a pointer to
+   the structure that AVL_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the tree element. */
+#define avl_entry(AVL_ELEM, STRUCT, MEMBER)                     \
+        ((STRUCT *) ((uint8_t *) &(AVL_ELEM)->height            \
+                     - offsetof (STRUCT, MEMBER.height)))
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than B. */
+typedef bool avl_less_func (const struct avl_elem *a,
+                            const struct avl_elem *b,
+                            void *aux);
+
+/* Tree. */
+struct avl
+  {
+    struct avl_elem *root;      /* Root element, or null if empty. */
+    size_t elem_cnt;            /* Number of elements. */
+    avl_less_func *less;        /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void avl_init (struct avl *, avl_less_func *, void *aux);
+
+/* Insertion, deletion, search. */
+void avl_insert (struct avl *, struct avl_elem *);
+void avl_remove (struct avl *, struct avl_elem *);
+struct avl_elem *avl_min (const struct avl *);
+
+/* Information. */
+size_t avl_size (const struct avl *);
+bool avl_empty (const struct avl *);
+
+#endif /* lib/kernel/avl.h */
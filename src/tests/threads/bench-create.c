@@ -0,0 +1,71 @@
+/* Measures the rate at which short-lived threads can be created
+   and exit.  Each round creates CREATE_CNT threads that do
+   nothing but exit, BATCH at a time, waiting for each batch to
+   finish before starting the next, and reports the time this
+   takes.  Small batches are served from the cache of exited
+   threads' pages, large ones mostly from the page allocator.
+   Creation is part of what is timed, so this does not use
+   bench_run(). */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Threads created in each round. */
+#define CREATE_CNT 20000
+
+static const int batch_sizes[] = {1, 4, 16, 64};
+
+static thread_func exit_thread;
+
+void
+test_bench_create (void)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof batch_sizes / sizeof *batch_sizes; i++)
+    {
+      struct semaphore done;
+      int64_t start, elapsed;
+      int created = 0;
+
+      sema_init (&done, 0);
+      start = timer_ticks ();
+      while (created < CREATE_CNT)
+        {
+          int batch = 0;
+          int j;
+
+          while (batch < batch_sizes[i])
+            {
+              if (thread_create ("exit", PRI_DEFAULT, exit_thread, &done)
+                  == TID_ERROR)
+                break;
+              batch++;
+            }
+          for (j = 0; j < batch; j++)
+            sema_down (&done);
+          if (batch < batch_sizes[i])
+            {
+              msg ("batches of %d: out of memory, stopping", batch_sizes[i]);
+              return;
+            }
+          created += batch;
+        }
+      elapsed = timer_elapsed (start);
+
+      msg ("batches of %d: %d threads in %lld ticks",
+           batch_sizes[i], created, elapsed);
+    }
+}
+
+static void
+exit_thread (void *done_)
+{
+  struct semaphore *done = done_;
+
+  sema_up (done);
+}
@@ -0,0 +1,149 @@
+/* Compares the cost of the kernel's locking primitives on a very
+   short critical section.  For each kind of lock, THREAD_CNT
+   threads at the same priority each enter and leave the critical
+   section ITER_CNT times, and the time this takes is reported.
+   The critical section is long enough that timer preemption
+   sometimes catches a thread inside it, so that the others find
+   the lock busy.
+
+   The kinds are a plain lock, a lock taken with
+   lock_acquire_adaptive(), a reader-writer lock taken only for
+   reading, and one taken for writing once in every WRITE_RATIO
+   entries.  Holders for writing increment a counter, holders
+   for reading only check that no writer is inside, and the
+   count is checked at the end of each round. */
+
+#include <stdio.h>
+#include <round.h>
+#include "tests/threads/tests.h"
+#include "tests/threads/bench.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define THREAD_CNT 8
+#define ITER_CNT 50000
+#define WRITE_RATIO 16
+
+/* Kinds of lock to compare. */
+enum kind
+  {
+    LOCK,                       /* lock_acquire(). */
+    ADAPTIVE,                   /* lock_acquire_adaptive(). */
+    RWLOCK_READ,                /* rwlock, reads only. */
+    RWLOCK_MIXED,               /* rwlock, some writes. */
+    KIND_CNT
+  };
+
+static const char *kind_names[KIND_CNT] =
+  {"lock", "adaptive lock", "rwlock (reads)", "rwlock (mixed)"};
+
+/* Shared by the threads of one round. */
+struct round
+  {
+    enum kind kind;
+    struct lock lock;
+    struct rwlock rwlock;
+    int counter;                /* Incremented by writers. */
+    volatile bool writing;      /* Writer inside? */
+  };
+
+static thread_func locker_thread;
+
+void
+test_bench_lock (void)
+{
+  enum kind kind;
+
+  for (kind = 0; kind < KIND_CNT; kind++)
+    {
+      struct round r;
+      int64_t elapsed;
+      int expected;
+
+      r.kind = kind;
+      lock_init (&r.lock);
+      rwlock_init (&r.rwlock);
+      r.counter = 0;
+      r.writing = false;
+
+      elapsed = bench_run ("locker", THREAD_CNT, locker_thread, &r);
+      if (elapsed < 0)
+        fail ("%s: out of memory", kind_names[kind]);
+
+      if (kind == RWLOCK_READ)
+        expected = 0;
+      else if (kind == RWLOCK_MIXED)
+        expected = THREAD_CNT * DIV_ROUND_UP (ITER_CNT, WRITE_RATIO);
+      else
+        expected = THREAD_CNT * ITER_CNT;
+      if (r.counter != expected)
+        fail ("%s: counter is %d, expected %d",
+              kind_names[kind], r.counter, expected);
+
+      msg ("%s: %d entries in %lld ticks",
+           kind_names[kind], THREAD_CNT * ITER_CNT, elapsed);
+    }
+}
+
+/* Busy work inside the critical section, which the current
+   thread holds exclusively if WRITE is true. */
+static void
+critical_section (struct round *r, bool write)
+{
+  volatile int i;
+
+  if (write)
+    r->writing = true;
+  else if (r->writing)
+    fail ("%s: reader entered while writer inside", kind_names[r->kind]);
+  for (i = 0; i < 20; i++)
+    continue;
+  if (write)
+    {
+      r->counter++;
+      r->writing = false;
+    }
+}
+
+static void
+locker_thread (void *r_)
+{
+  struct round *r = r_;
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++)
+    switch (r->kind)
+      {
+      case LOCK:
+        lock_acquire (&r->lock);
+        critical_section (r, true);
+        lock_release (&r->lock);
+        break;
+
+      case ADAPTIVE:
+        lock_acquire_adaptive (&r->lock);
+        critical_section (r, true);
+        lock_release (&r->lock);
+        break;
+
+      case RWLOCK_MIXED:
+        if (i % WRITE_RATIO == 0)
+          {
+            rwlock_acquire_write (&r->rwlock);
+            critical_section (r, true);
+            rwlock_release_write (&r->rwlock);
+            break;
+          }
+        /* Fall through. */
+
+      case RWLOCK_READ:
+        rwlock_acquire_read (&r->rwlock);
+        critical_section (r, false);
+        rwlock_release_read (&r->rwlock);
+        break;
+
+      default:
+        NOT_REACHED ();
+      }
+}
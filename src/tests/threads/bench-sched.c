@@ -0,0 +1,55 @@
+/* Measures how the cost of scheduling grows with the number of
+   runnable threads.  For each thread count, that many threads at
+   the same priority take turns yielding the CPU until
+   YIELD_CNT yields have happened in all, and the time this takes
+   is reported.  With a constant-time scheduler, the time per
+   yield should not depend on the thread count.
+
+   Each thread needs a page of memory, so run this with enough
+   RAM for the largest count, e.g. "pintos -m 16 -- run
+   bench-sched". */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "tests/threads/bench.h"
+#include "threads/init.h"
+#include "threads/thread.h"
+
+/* Total number of yields in each round. */
+#define YIELD_CNT 100000
+
+static const int thread_cnts[] = {10, 30, 100, 300, 1000};
+
+static thread_func yield_thread;
+
+void
+test_bench_sched (void)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof thread_cnts / sizeof *thread_cnts; i++)
+    {
+      int iterations = YIELD_CNT / thread_cnts[i];
+      int64_t elapsed;
+
+      elapsed = bench_run ("yield", thread_cnts[i], yield_thread,
+                           &iterations);
+      if (elapsed < 0)
+        {
+          msg ("%d threads: out of memory, stopping", thread_cnts[i]);
+          break;
+        }
+      msg ("%d threads: %d yields in %lld ticks",
+           thread_cnts[i], iterations * thread_cnts[i], elapsed);
+    }
+}
+
+static void
+yield_thread (void *iterations_)
+{
+  int *iterations = iterations_;
+  int i;
+
+  for (i = 0; i < *iterations; i++)
+    thread_yield ();
+}
@@ -0,0 +1,57 @@
+#include "tests/threads/bench.h"
+#include <debug.h>
+#include "threads/synch.h"
+#include "devices/timer.h"
+
+/* Shared by the threads of one bench_run(). */
+struct bench
+  {
+    thread_func *func;          /* Function each thread runs. */
+    void *aux;                  /* Its argument. */
+    struct semaphore done;      /* Up'd by each thread as it returns. */
+  };
+
+static thread_func bench_thread;
+
+/* Creates THREAD_CNT threads named NAME at the default priority,
+   each of which calls FUNC with AUX, and waits for all of them
+   to return.  The threads are created while we outrank them, so
+   that none starts until all are ready to go.
+
+   Returns the number of timer ticks from the moment the threads
+   were released until the last one returned, or -1 if some of
+   them could not be created, in which case those that were are
+   still run to completion. */
+int64_t
+bench_run (const char *name, int thread_cnt, thread_func *func, void *aux)
+{
+  struct bench b;
+  int64_t start, elapsed;
+  int created, i;
+
+  b.func = func;
+  b.aux = aux;
+  sema_init (&b.done, 0);
+
+  thread_set_priority (PRI_DEFAULT + 1);
+  for (created = 0; created < thread_cnt; created++)
+    if (thread_create (name, PRI_DEFAULT, bench_thread, &b) == TID_ERROR)
+      break;
+
+  start = timer_ticks ();
+  thread_set_priority (PRI_DEFAULT);
+  for (i = 0; i < created; i++)
+    sema_down (&b.done);
+  elapsed = timer_elapsed (start);
+
+  return created == thread_cnt ? elapsed : -1;
+}
+
+static void
+bench_thread (void *b_)
+{
+  struct bench *b = b_;
+
+  b->func (b->aux);
+  sema_up (&b->done);
+}
@@ -0,0 +1,13 @@
+#ifndef TESTS_THREADS_BENCH_H
+#define TESTS_THREADS_BENCH_H
+
+/* Support for the bench-* programs.  These are benchmarks, not
+   tests: they report timings, so they have no expected output. */
+
+#include <stdint.h>
+#include "threads/thread.h"
+
+int64_t bench_run (const char *name, int thread_cnt,
+                   thread_func *func, void *aux);
+
+#endif /* tests/threads/bench.h */
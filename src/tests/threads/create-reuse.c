@@ -0,0 +1,45 @@
+/* Checks that thread_create() reuses the page of a thread that
+   has exited, and that the page stops looking like a thread as
+   soon as its thread is dead, so that a stale pointer to it
+   fails the is_thread() assertions.
+
+   Each thread we create outranks us, so it runs and exits
+   before thread_create() returns. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/thread.h"
+
+static thread_func record_thread;
+
+void
+test_create_reuse (void)
+{
+  struct thread *first, *second;
+  tid_t first_tid, second_tid;
+
+  /* This test needs a priority scheduler. */
+  ASSERT (!thread_mlfqs && !thread_cfs);
+
+  first_tid = thread_create ("first", PRI_DEFAULT + 1, record_thread, &first);
+  if (first->magic == thread_current ()->magic)
+    fail ("dead thread's page still has a thread's magic number");
+  msg ("dead thread's page is not a thread.");
+
+  second_tid = thread_create ("second", PRI_DEFAULT + 1, record_thread,
+                              &second);
+  if (second != first)
+    fail ("new thread did not reuse the dead thread's page");
+  if (second_tid == first_tid)
+    fail ("new thread reused the dead thread's tid");
+  msg ("new thread reused the dead thread's page.");
+}
+
+static void
+record_thread (void *self_)
+{
+  struct thread **self = self_;
+
+  *self = thread_current ();
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(create-reuse) begin
+(create-reuse) dead thread's page is not a thread.
+(create-reuse) new thread reused the dead thread's page.
+(create-reuse) end
+EOF
+pass;
@@ -0,0 +1,77 @@
+/* Checks the order in which ready threads run: highest priority
+   first, and first come, first served among threads of equal
+   priority.  Threads at priorities on both sides of word
+   boundaries in the run queue bitmap are created in a scrambled
+   order while we outrank them all, then we drop below them and
+   they run, each recording its priority and rank within it. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Priorities used, in order of creation. */
+static const int priorities[] = {31, 2, 62, 32, 1, 61, 33, 30};
+#define PRIORITY_CNT (sizeof priorities / sizeof *priorities)
+
+/* Threads created at each priority. */
+#define PER_PRIORITY 3
+
+#define THREAD_CNT (PRIORITY_CNT * PER_PRIORITY)
+
+/* A thread's priority and rank among threads of that priority. */
+struct worker
+  {
+    int priority;
+    int rank;
+  };
+
+static struct worker workers[THREAD_CNT];
+static struct worker *order[THREAD_CNT];
+static int order_cnt;
+static struct semaphore done;
+
+static thread_func worker_thread;
+
+void
+test_priority_ready_order (void)
+{
+  size_t i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&done, 0);
+  thread_set_priority (PRI_MAX);
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      struct worker *w = &workers[i];
+      char name[16];
+
+      w->priority = priorities[i % PRIORITY_CNT];
+      w->rank = i / PRIORITY_CNT;
+      snprintf (name, sizeof name, "pri %d.%d", w->priority, w->rank);
+      thread_create (name, w->priority, worker_thread, w);
+    }
+
+  thread_set_priority (PRI_MIN);
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    msg ("priority %d, thread %d", order[i]->priority, order[i]->rank);
+}
+
+static void
+worker_thread (void *w_)
+{
+  struct worker *w = w_;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  order[order_cnt++] = w;
+  intr_set_level (old_level);
+  sema_up (&done);
+}
@@ -0,0 +1,33 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-ready-order) begin
+(priority-ready-order) priority 62, thread 0
+(priority-ready-order) priority 62, thread 1
+(priority-ready-order) priority 62, thread 2
+(priority-ready-order) priority 61, thread 0
+(priority-ready-order) priority 61, thread 1
+(priority-ready-order) priority 61, thread 2
+(priority-ready-order) priority 33, thread 0
+(priority-ready-order) priority 33, thread 1
+(priority-ready-order) priority 33, thread 2
+(priority-ready-order) priority 32, thread 0
+(priority-ready-order) priority 32, thread 1
+(priority-ready-order) priority 32, thread 2
+(priority-ready-order) priority 31, thread 0
+(priority-ready-order) priority 31, thread 1
+(priority-ready-order) priority 31, thread 2
+(priority-ready-order) priority 30, thread 0
+(priority-ready-order) priority 30, thread 1
+(priority-ready-order) priority 30, thread 2
+(priority-ready-order) priority 2, thread 0
+(priority-ready-order) priority 2, thread 1
+(priority-ready-order) priority 2, thread 2
+(priority-ready-order) priority 1, thread 0
+(priority-ready-order) priority 1, thread 1
+(priority-ready-order) priority 1, thread 2
+(priority-ready-order) end
+EOF
+pass;
@@ -0,0 +1,71 @@
+/* Checks a reader-writer lock.  First the main thread holds it
+   for writing: a reader and then a writer, each of higher
+   priority, must wait for it, donating their priorities to the
+   main thread through the lock's gate.  Then the main thread
+   holds it for reading: a writer waits for it to leave, and a
+   reader of still higher priority that arrives after the writer
+   must not get in ahead of it. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static struct rwlock rwlock;
+
+static thread_func reader_thread;
+static thread_func writer_thread;
+
+void
+test_priority_rwlock (void)
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  rwlock_init (&rwlock);
+
+  rwlock_acquire_write (&rwlock);
+  msg ("main holds the lock for writing.");
+  thread_create ("reader", PRI_DEFAULT + 1, reader_thread, NULL);
+  msg ("main should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 1, thread_get_priority ());
+  thread_create ("writer", PRI_DEFAULT + 2, writer_thread, NULL);
+  msg ("main should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 2, thread_get_priority ());
+  rwlock_release_write (&rwlock);
+  msg ("writer and reader should have finished.");
+  msg ("main should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+
+  rwlock_acquire_read (&rwlock);
+  msg ("main holds the lock for reading.");
+  thread_create ("writer", PRI_DEFAULT + 1, writer_thread, NULL);
+  thread_create ("reader", PRI_DEFAULT + 2, reader_thread, NULL);
+  msg ("main releasing the lock.");
+  rwlock_release_read (&rwlock);
+  msg ("writer and reader should have finished.");
+}
+
+static void
+reader_thread (void *aux UNUSED)
+{
+  msg ("%s acquiring the lock for reading.", thread_name ());
+  rwlock_acquire_read (&rwlock);
+  msg ("%s got the lock for reading.", thread_name ());
+  rwlock_release_read (&rwlock);
+  msg ("%s done.", thread_name ());
+}
+
+static void
+writer_thread (void *aux UNUSED)
+{
+  msg ("%s acquiring the lock for writing.", thread_name ());
+  rwlock_acquire_write (&rwlock);
+  msg ("%s got the lock for writing.", thread_name ());
+  rwlock_release_write (&rwlock);
+  msg ("%s done.", thread_name ());
+}
@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-rwlock) begin
+(priority-rwlock) main holds the lock for writing.
+(priority-rwlock) reader acquiring the lock for reading.
+(priority-rwlock) main should have priority 32.  Actual priority: 32.
+(priority-rwlock) writer acquiring the lock for writing.
+(priority-rwlock) main should have priority 33.  Actual priority: 33.
+(priority-rwlock) writer got the lock for writing.
+(priority-rwlock) writer done.
+(priority-rwlock) reader got the lock for reading.
+(priority-rwlock) reader done.
+(priority-rwlock) writer and reader should have finished.
+(priority-rwlock) main should have priority 31.  Actual priority: 31.
+(priority-rwlock) main holds the lock for reading.
+(priority-rwlock) writer acquiring the lock for writing.
+(priority-rwlock) reader acquiring the lock for reading.
+(priority-rwlock) main releasing the lock.
+(priority-rwlock) writer got the lock for writing.
+(priority-rwlock) reader got the lock for reading.
+(priority-rwlock) reader done.
+(priority-rwlock) writer done.
+(priority-rwlock) writer and reader should have finished.
+(priority-rwlock) end
+EOF
+pass;
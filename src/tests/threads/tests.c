@@ -29,6 +29,9 @@ static const struct test tests[] =
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
     {"priority-condvar", test_priority_condvar},
+    {"priority-ready-order", test_priority_ready_order},
+    {"priority-rwlock", test_priority_rwlock},
+    {"create-reuse", test_create_reuse},
     {"mlfqs-load-1", test_mlfqs_load_1},
     {"mlfqs-load-60", test_mlfqs_load_60},
     {"mlfqs-load-avg", test_mlfqs_load_avg},
@@ -38,6 +41,11 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"cfs-fair-2", test_cfs_fair_2},
+    {"cfs-nice-3", test_cfs_nice_3},
+    {"bench-sched", test_bench_sched},
+    {"bench-lock", test_bench_lock},
+    {"bench-create", test_bench_create},
   };
 
 static const char *test_name;
@@ -23,6 +23,9 @@ extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
 extern test_func test_priority_condvar;
+extern test_func test_priority_ready_order;
+extern test_func test_priority_rwlock;
+extern test_func test_create_reuse;
 extern test_func test_mlfqs_load_1;
 extern test_func test_mlfqs_load_60;
 extern test_func test_mlfqs_load_avg;
@@ -32,6 +35,11 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_cfs_fair_2;
+extern test_func test_cfs_nice_3;
+extern test_func test_bench_sched;
+extern test_func test_bench_lock;
+extern test_func test_bench_create;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
@@ -31,10 +31,23 @@
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 
-bool waiters_priority_compare (const struct list_elem *a,
-                                 const struct list_elem *b,
-                                 void *aux);
+/* Wait queues.
+
+   The threads waiting on a semaphore or condition variable are
+   kept in a balanced tree, highest priority first and in order
+   of arrival among equal priorities, so that the thread to wake
+   is found and removed in O(log n) time with interrupts off.  A
+   waiter whose priority changes, by donation or under the MLFQS
+   scheduler, is moved within the tree by thread.c, which is why
+   each thread records the queue it is on. */
+static avl_less_func waiter_less;
+static void wait_enqueue (struct avl *, struct thread *);
+static struct thread *wait_dequeue (struct avl *);
+
+/* Arrival counter for wait queues. */
+static uint64_t next_wait_seq;
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -51,7 +64,7 @@ sema_init (struct semaphore *sema, unsigned value)
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  avl_init (&sema->waiters, waiter_less, NULL);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -72,7 +85,7 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0) 
     {
-      list_push_back (&sema->waiters, &thread_current ()->elem);
+      wait_enqueue (&sema->waiters, thread_current ());
       thread_block ();
     }
   sema->value--;
@@ -119,13 +132,9 @@ sema_up (struct semaphore *sema)
 
   sema->value++;
   bool should_yield = false;
-  if (!list_empty (&sema->waiters)) 
+  if (!avl_empty (&sema->waiters)) 
     {
-      struct list_elem *max_priority = list_min (&sema -> waiters,
-                                                  thread_priority_compare,
-                                                  NULL); 
-      struct thread *t = list_entry (max_priority, struct thread, elem);
-      list_remove (max_priority);
+      struct thread *t = wait_dequeue (&sema->waiters);
       thread_unblock (t);
       /* Determine whether we should immediately yield to unblocked thread */
       if (t->priority > thread_current ()->priority)
@@ -219,6 +228,9 @@ lock_acquire (struct lock *lock)
 
   enum intr_level old_level = intr_disable ();
 
+  if (lock->semaphore.value == 0)
+    trace_record (TRACE_LOCK_CONTEND, thread_tid (), (uintptr_t) lock);
+
   /* Handle priority donation */
   if (!thread_mlfqs) 
     {
@@ -248,7 +260,7 @@ lock_acquire (struct lock *lock)
         
       while (sema->value == 0) 
         {
-          list_push_back (&sema->waiters, &thread_current ()->elem);
+          wait_enqueue (&sema->waiters, thread_current ());
           thread_block ();
         }
       sema->value--;
@@ -260,6 +272,7 @@ lock_acquire (struct lock *lock)
     sema_down (&lock->semaphore);
 
   lock->holder = thread_current ();
+  trace_record (TRACE_LOCK_ACQUIRE, thread_tid (), (uintptr_t) lock);
   intr_set_level (old_level);
 }
 
@@ -277,12 +290,64 @@ lock_try_acquire (struct lock *lock)
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  enum intr_level old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->holder = thread_current ();
+      trace_record (TRACE_LOCK_ACQUIRE, thread_tid (), (uintptr_t) lock);
+      /* Track the lock for priority donation, as lock_acquire()
+         does, so that lock_release() finds it. */
+      if (!thread_mlfqs)
+        list_push_back (&thread_current ()->acquired_locks,
+                        &lock->lock_elem);
+    }
+  intr_set_level (old_level);
   return success;
 }
 
+/* Maximum number of times lock_acquire_adaptive() yields to the
+   holder before blocking. */
+#define ADAPTIVE_SPINS 4
+
+/* Acquires LOCK, which should guard only a very short critical
+   section, like lock_acquire().  If LOCK is busy and its holder
+   could run in our place, that is, its priority is at least
+   ours, we first yield to it up to ADAPTIVE_SPINS times in the
+   hope that it releases LOCK, and only then block.
+
+   On a uniprocessor, spinning in place cannot let the holder
+   make progress, so the "spin" is a yield.  A holder of lower
+   priority would not get the CPU from a yield, so we block at
+   once and donate to it instead.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+lock_acquire_adaptive (struct lock *lock)
+{
+  int spins;
+
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!lock_held_by_current_thread (lock));
+
+  for (spins = 0; spins < ADAPTIVE_SPINS; spins++)
+    {
+      struct thread *holder;
+
+      if (lock_try_acquire (lock))
+        return;
+      holder = lock->holder;
+      if (holder == NULL
+          || holder->status != THREAD_READY
+          || holder->priority < thread_get_priority ())
+        break;
+      thread_yield ();
+    }
+  lock_acquire (lock);
+}
+
 /* Releases LOCK, which must be owned by the current thread.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -295,6 +360,7 @@ lock_release (struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   enum intr_level old_level = intr_disable ();
 
+  trace_record (TRACE_LOCK_RELEASE, thread_tid (), (uintptr_t) lock);
   lock->holder = NULL;
   /* Remove lock_elem from acquired_locks list */
   if (lock->lock_elem.prev != NULL && lock->lock_elem.next != NULL)
@@ -305,16 +371,10 @@ lock_release (struct lock *lock)
   int original_priority = t->original_priority;
   bool should_yield = false;
 
-  if (!list_empty (&sema->waiters)) 
+  if (!avl_empty (&sema->waiters)) 
     {
       /* Determine which thread that was waiting for this lock to unblock */
-      struct list_elem *max_pri_elem = list_min (&sema->waiters,
-                                                 thread_priority_compare,
-                                                 NULL); 
-      struct thread *to_unblock = list_entry (max_pri_elem, 
-                                              struct thread, 
-                                              elem);
-      list_remove (max_pri_elem);
+      struct thread *to_unblock = wait_dequeue (&sema->waiters);
 
       /* Update current thread's priority */
       if (!thread_mlfqs) 
@@ -322,7 +382,9 @@ lock_release (struct lock *lock)
           int max_priority = max_waiter_priority (t);
           int new_priority = (max_priority > original_priority) 
                               ? max_priority : original_priority;
-          t->priority = new_priority;
+          /* We may be on a condition's wait queue (see
+             cond_wait()). */
+          thread_change_priority (t, new_priority);
         }
 
       thread_unblock (to_unblock);
@@ -349,13 +411,109 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. Used by condition to renotify one waiter. */
-struct semaphore_elem 
-  {
-    struct list_elem elem;              /* List element. */
-    struct semaphore semaphore;         /* This semaphore. */
-    struct thread *waiting;             /* Thread waiting on this semaphore */
-  };
+/* Initializes reader-writer lock RW.  Any number of readers may
+   hold RW at once, or a single writer.
+
+   Writers take precedence: once a writer is waiting for RW, new
+   readers wait until it has finished.  A writer holds the
+   internal lock `gate' throughout, and every reader passes
+   through `gate' on the way in, so waiting readers and writers
+   donate their priority to the writer holding RW or waiting for
+   it.  A writer waiting for readers to leave does not donate to
+   them, since they are not tracked individually.
+
+   RW may not be acquired recursively in either mode. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->gate);
+  rw->readers = 0;
+  rw->writer_waiting = false;
+  sema_init (&rw->drained, 0);
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   waits for it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!rwlock_held_by_current_thread (rw));
+
+  lock_acquire (&rw->gate);
+  old_level = intr_disable ();
+  rw->readers++;
+  intr_set_level (old_level);
+  lock_release (&rw->gate);
+}
+
+/* Releases RW, which the current thread holds for reading.  The
+   last reader to leave wakes a waiting writer. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+
+  old_level = intr_disable ();
+  ASSERT (rw->readers > 0);
+  if (--rw->readers == 0 && rw->writer_waiting)
+    {
+      rw->writer_waiting = false;
+      sema_up (&rw->drained);
+    }
+  intr_set_level (old_level);
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds
+   it in either mode.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->gate);
+  old_level = intr_disable ();
+  if (rw->readers > 0)
+    {
+      rw->writer_waiting = true;
+      sema_down (&rw->drained);
+    }
+  intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread holds for writing. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_release (&rw->gate);
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise.  Readers are not tracked, so there is no
+   equivalent for reading. */
+bool
+rwlock_held_by_current_thread (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return lock_held_by_current_thread (&rw->gate);
+}
 
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
@@ -365,7 +523,7 @@ cond_init (struct condition *cond)
 {
   ASSERT (cond != NULL);
 
-  list_init (&cond->waiters);
+  avl_init (&cond->waiters, waiter_less, NULL);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -391,33 +549,26 @@ cond_init (struct condition *cond)
 void
 cond_wait (struct condition *cond, struct lock *lock) 
 {
-  struct semaphore_elem waiter;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
   
-  sema_init (&waiter.semaphore, 0);
-  waiter.waiting = thread_current ();
-  list_push_back (&cond->waiters, &waiter.elem);
+  old_level = intr_disable ();
+  wait_enqueue (&cond->waiters, cur);
   lock_release (lock);
-  sema_down (&waiter.semaphore);
-  lock_acquire (lock);
-}
 
-/* Comparison function for which which cond waiters are higher priority. */
-bool waiters_priority_compare (const struct list_elem *a,
-                                 const struct list_elem *b,
-                                 void *aux) {
-    (void) aux;
-    struct semaphore_elem *a_waiter = list_entry (a,
-                                                  struct semaphore_elem, 
-                                                  elem);
-    struct semaphore_elem *b_waiter = list_entry (b,
-                                                  struct semaphore_elem, 
-                                                  elem);
-    return a_waiter->waiting->priority > b_waiter->waiting->priority;
+  /* Releasing LOCK may have yielded to a waiter, and COND may
+     have been signaled before we got the CPU back: cond_signal()
+     only unblocks a thread that is blocked. */
+  while (cur->wait_queue != NULL)
+    thread_block ();
+  intr_set_level (old_level);
+
+  lock_acquire (lock);
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
@@ -431,23 +582,26 @@ bool waiters_priority_compare (const struct list_elem *a,
 void
 cond_signal (struct condition *cond, struct lock *lock UNUSED) 
 {
+  enum intr_level old_level;
+  bool should_yield = false;
+
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  if (!list_empty (&cond->waiters)) 
+  old_level = intr_disable ();
+  if (!avl_empty (&cond->waiters)) 
     {
-      struct list_elem* max_pri_elem = list_min (&cond->waiters,
-                                                 waiters_priority_compare,
-                                                 NULL);
-      list_remove (max_pri_elem);
-      sema_up (&list_entry (max_pri_elem, 
-                            struct semaphore_elem,
-                            elem
-                            )->semaphore);
-
+      struct thread *t = wait_dequeue (&cond->waiters);
+      if (t->status == THREAD_BLOCKED)
+        thread_unblock (t);
+      if (t->priority > thread_current ()->priority)
+        should_yield = true;
     } 
+  intr_set_level (old_level);
+  if (should_yield)
+    thread_yield ();
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -462,6 +616,48 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
 
-  while (!list_empty (&cond->waiters))
+  while (!avl_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Orders threads in a wait queue: higher priority first, then
+   earlier arrival first. */
+static bool
+waiter_less (const struct avl_elem *a_, const struct avl_elem *b_,
+             void *aux UNUSED)
+{
+  const struct thread *a = avl_entry (a_, struct thread, wait_elem);
+  const struct thread *b = avl_entry (b_, struct thread, wait_elem);
+
+  if (a->priority != b->priority)
+    return a->priority > b->priority;
+  return a->wait_seq < b->wait_seq;
+}
+
+/* Adds T to the back of wait queue Q, among the threads of its
+   priority.  Interrupts must be off. */
+static void
+wait_enqueue (struct avl *q, struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->wait_queue == NULL);
+
+  t->wait_seq = next_wait_seq++;
+  t->wait_queue = q;
+  avl_insert (q, &t->wait_elem);
+}
+
+/* Removes and returns the highest priority thread in wait queue
+   Q, which must not be empty.  Interrupts must be off. */
+static struct thread *
+wait_dequeue (struct avl *q)
+{
+  struct thread *t;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  t = avl_entry (avl_min (q), struct thread, wait_elem);
+  avl_remove (q, &t->wait_elem);
+  t->wait_queue = NULL;
+  return t;
+}
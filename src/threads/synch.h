@@ -1,6 +1,7 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <avl.h>
 #include <list.h>
 #include <stdbool.h>
 
@@ -8,7 +9,7 @@
 struct semaphore 
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct avl waiters;         /* Waiting threads, by priority. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -28,13 +29,30 @@ struct lock
 void lock_init (struct lock *);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
+void lock_acquire_adaptive (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
 
+/* Reader-writer lock. */
+struct rwlock
+  {
+    struct lock gate;           /* Held by writer, briefly by readers. */
+    unsigned readers;           /* Number of readers holding it. */
+    bool writer_waiting;        /* Writer waiting for readers to leave? */
+    struct semaphore drained;   /* Up'd for writer when readers leave. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_by_current_thread (const struct rwlock *);
+
 /* Condition variable. */
 struct condition 
   {
-    struct list waiters;        /* List of waiting threads. */
+    struct avl waiters;         /* Waiting threads, by priority. */
   };
 
 void cond_init (struct condition *);
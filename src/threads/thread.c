@@ -11,6 +11,7 @@
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -21,15 +22,52 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. Only used 
-   if thread_mlfqs is false */
-static struct list ready_list;
-
-/* List of ready lists for each priority level. Only used if 
-   thread_mlfqs is true. pri_queues[i] correspends to the
-   ready queue for threads with priority i. */
-static struct list pri_queues[PRI_MAX + 1];
+/* The run queue, holding processes in THREAD_READY state, that
+   is, processes that are ready to run but not actually running.
+   Used by the priority and MLFQS schedulers.  ready_queues[i]
+   is a FIFO list of the ready threads with priority i.
+   ready_map has a bit set for each nonempty list, so that the
+   highest priority with a ready thread is found with a single
+   bit scan: bit j of the map stands for priority PRI_MAX - j, so
+   that BSF, which finds the lowest set bit, finds the highest
+   priority. */
+#define READY_MAP_WORDS ((PRI_MAX + 32) / 32)
+static struct list ready_queues[PRI_MAX + 1];
+static uint32_t ready_map[READY_MAP_WORDS];
+static int ready_cnt;                   /* Number of ready threads. */
+
+/* The fair-share scheduler's run queue instead orders ready
+   threads by vruntime, the CPU time each has had, in units of
+   1/VRUNTIME_UNIT tick, scaled down by the weight of the
+   thread's niceness relative to NICE_0_WEIGHT.  Each nice level
+   is worth about 10% CPU time.  The running thread is preempted
+   once a ready thread's vruntime falls more than CFS_GRANULARITY
+   behind its own.
+
+   A thread that wakes up gets the run queue's minimum vruntime,
+   less SLEEPER_CREDIT, if that is more than its own, so that it
+   neither monopolizes the CPU after a long sleep nor loses its
+   place after a short one. */
+#define VRUNTIME_UNIT 1024
+#define NICE_0_WEIGHT 1024
+#define CFS_GRANULARITY VRUNTIME_UNIT
+#define SLEEPER_CREDIT (VRUNTIME_UNIT * TIME_SLICE / 2)
+static struct avl cfs_queue;
+static uint64_t min_vruntime;           /* Never decreases. */
+
+/* Weight of each niceness, from -20 to 20. */
+static const int nice_weights[] =
+  {
+    /* -20 */ 88761, 71755, 56483, 46273, 36291,
+    /* -15 */ 29154, 23254, 18705, 14949, 11916,
+    /* -10 */  9548,  7620,  6100,  4904,  3906,
+    /*  -5 */  3121,  2501,  1991,  1586,  1277,
+    /*   0 */  1024,   820,   655,   526,   423,
+    /*   5 */   335,   272,   215,   172,   137,
+    /*  10 */   110,    87,    70,    56,    45,
+    /*  15 */    36,    29,    23,    18,    15,
+    /*  20 */    12,
+  };
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -65,11 +103,46 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
 static fixed_point_t load_avg;
 
+/* Under the MLFQS scheduler, every thread's recent_cpu decays
+   once a second, but only the running thread is brought up to
+   date then.  The others catch up later: recent_cpu_sec says how
+   many of the decays a thread has had, and decay_coeffs holds
+   the coefficient of each of the last DECAY_HISTORY decays.
+
+   A decay starts a sweep over all_list that catches up
+   SWEEP_BATCH threads per timer tick, recomputing their
+   priorities and moving them within their run or wait queues,
+   so that the timer interrupt's cost does not grow with the
+   number of threads.  A thread that wakes before the sweep
+   reaches it catches up in thread_unblock().  Until the sweep
+   ends, a wait queue may thus wake a thread ahead of one whose
+   priority the last decay raised above it. */
+#define DECAY_HISTORY 64
+#define SWEEP_BATCH 8
+static fixed_point_t decay_coeffs[DECAY_HISTORY];
+static int64_t decay_cnt;               /* Decays so far. */
+static struct list_elem *sweep_next;    /* Next to catch up, or null. */
+static int64_t sweep_decay_cnt;         /* Decays the sweep applies. */
+
+/* Pages of recently exited threads, kept for reuse by
+   thread_create() so that creating a thread need not take the
+   page allocator's lock or zero a page.  init_thread() clears the
+   struct thread, and nothing relies on the rest of the page being
+   zero.  Protected by disabling interrupts, since pages are added
+   in thread_schedule_tail(). */
+#define PAGE_CACHE_SIZE 8
+static struct thread *page_cache[PAGE_CACHE_SIZE];
+static size_t page_cache_cnt;
+
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* If true, use the fair-share scheduler.
+   Controlled by kernel command-line option "-cfs". */
+bool thread_cfs;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -78,12 +151,17 @@ static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
+static struct thread *alloc_thread_page (void);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
 void update_priority (struct thread *t, void *aux);
 int num_ready_threads (void);
 void add_to_ready_queue (struct thread *t);
+static void remove_from_ready_queue (struct thread *t);
+static void sweep_step (void);
+static avl_less_func vruntime_less;
+static void update_min_vruntime (void);
 struct thread *highest_priority_thread (void);
 
 /* Initializes the threading system by transforming the code
@@ -106,21 +184,18 @@ thread_init (void)
 
   lock_init (&tid_lock);
   list_init (&all_list);
-  if (thread_mlfqs) 
-    {
-      for (int i = 0; i <= PRI_MAX; i++)
-        {
-          list_init(&pri_queues[i]);
-        }
-    } 
-  else
-    list_init (&ready_list);
+  if (thread_mlfqs && thread_cfs)
+    PANIC ("-mlfqs and -cfs cannot be used together");
+  for (int i = 0; i <= PRI_MAX; i++)
+    list_init (&ready_queues[i]);
+  avl_init (&cfs_queue, vruntime_less, NULL);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
+  trace_name (initial_thread->tid, initial_thread->name);
 
   load_avg = fix_int (0);
 }
@@ -158,17 +233,45 @@ calculate_load_avg (void)
   load_avg = fix_add (load_avg, prod2);
 } 
 
-/* Computes recent cpu usage for a thread using moving average. */
+/* Computes recent cpu usage for a thread using moving average,
+   applying each of the once-a-second decays it has missed. */
 void
 calculate_recent_cpu (struct thread *t, void *aux)
 {
   (void) aux;
+  ASSERT (decay_cnt - t->recent_cpu_sec <= DECAY_HISTORY);
+
+  while (t->recent_cpu_sec < decay_cnt)
+    {
+      fixed_point_t coeff = decay_coeffs[t->recent_cpu_sec % DECAY_HISTORY];
+      fixed_point_t prod = fix_mul (coeff, t->recent_cpu);
+      t->recent_cpu = fix_add (prod, fix_int (t->nice));
+      t->recent_cpu_sec++;
+    }
+}
+
+/* Starts a once-a-second decay of every thread's recent_cpu,
+   using the current load average. */
+static void
+start_decay (void)
+{
   fixed_point_t a = fix_scale (load_avg, 2);
   fixed_point_t b = fix_add (a, fix_int (1));
-  fixed_point_t coeff = fix_div (a, b);
 
-  fixed_point_t prod = fix_mul (coeff, t->recent_cpu);
-  t->recent_cpu = fix_add (prod, fix_int (t->nice));
+  decay_coeffs[decay_cnt % DECAY_HISTORY] = fix_div (a, b);
+  decay_cnt++;
+}
+
+/* Brings thread T's recent_cpu and priority up to date, under
+   the MLFQS scheduler.  T need not be running. */
+void
+thread_refresh_priority (struct thread *t)
+{
+  if (thread_mlfqs)
+    {
+      calculate_recent_cpu (t, NULL);
+      update_priority (t, NULL);
+    }
 }
 
 /* Recalculates and updates priority for struct thread *t. Does not
@@ -188,7 +291,30 @@ update_priority (struct thread *t, void *aux)
   else if (priority < PRI_MIN)
     priority = PRI_MIN;
 
+  thread_change_priority (t, priority);
+}
+
+/* Sets T's priority to PRIORITY, moving T to its new place in
+   the run queue or in the wait queue that it is on.  Interrupts
+   must be off if T is on either. */
+void
+thread_change_priority (struct thread *t, int priority)
+{
+  if (priority == t->priority)
+    return;
+
+  if (t->wait_queue != NULL)
+    avl_remove (t->wait_queue, &t->wait_elem);
+  if (t->status == THREAD_READY && t != idle_thread)
+    remove_from_ready_queue (t);
+
   t->priority = priority;
+  trace_record (TRACE_PRIORITY, t->tid, priority);
+
+  if (t->wait_queue != NULL)
+    avl_insert (t->wait_queue, &t->wait_elem);
+  if (t->status == THREAD_READY && t != idle_thread)
+    add_to_ready_queue (t);
 }
 
 
@@ -219,15 +345,123 @@ thread_tick (void)
   if (thread_mlfqs && timer_ticks () % TIMER_FREQ == 0) 
     {
       calculate_load_avg ();
-      thread_foreach (calculate_recent_cpu, NULL);
+      start_decay ();
+      calculate_recent_cpu (t, NULL);
+      if (sweep_next == NULL)
+        {
+          sweep_next = list_begin (&all_list);
+          sweep_decay_cnt = decay_cnt;
+        }
     }
+  if (sweep_next != NULL)
+    sweep_step ();
 
+  /* Only the running thread's recent_cpu changes between
+     decays. */
   if (thread_mlfqs && timer_ticks () % PRI_UPDATE_INTERVAL == 0)
-    thread_foreach(update_priority, NULL);
+    update_priority (t, NULL);
+
+  /* Charge the fair-share scheduler's running thread. */
+  if (thread_cfs && t != idle_thread)
+    {
+      t->vruntime += ((uint64_t) VRUNTIME_UNIT * NICE_0_WEIGHT
+                      / nice_weights[t->nice - NICE_MIN]);
+      update_min_vruntime ();
+    }
 
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
+  else if (thread_cfs && t != idle_thread)
+    {
+      struct thread *next = highest_priority_thread ();
+      if (next != idle_thread
+          && next->vruntime + CFS_GRANULARITY < t->vruntime)
+        intr_yield_on_return ();
+    }
+}
+
+/* Advances min_vruntime to the least vruntime of the running and
+   ready threads, if that is greater. */
+static void
+update_min_vruntime (void)
+{
+  struct thread *cur = running_thread ();
+  struct thread *next = highest_priority_thread ();
+  uint64_t least;
+
+  if (cur != idle_thread && cur->status == THREAD_RUNNING)
+    least = cur->vruntime;
+  else if (next != idle_thread)
+    least = next->vruntime;
+  else
+    return;
+  if (next != idle_thread && next->vruntime < least)
+    least = next->vruntime;
+
+  if (least > min_vruntime)
+    min_vruntime = least;
+}
+
+/* Orders threads by vruntime, then by tid, for the fair-share
+   scheduler's run queue. */
+static bool
+vruntime_less (const struct avl_elem *a_, const struct avl_elem *b_,
+               void *aux UNUSED)
+{
+  const struct thread *a = avl_entry (a_, struct thread, cfs_elem);
+  const struct thread *b = avl_entry (b_, struct thread, cfs_elem);
+
+  if (a->vruntime != b->vruntime)
+    return a->vruntime < b->vruntime;
+  return a->tid < b->tid;
+}
+
+/* Catches up the next SWEEP_BATCH threads of the sweep started
+   by the last decay.  A sweep that ends after a later decay
+   starts over, so that no thread misses it. */
+static void
+sweep_step (void)
+{
+  int i;
+
+  for (i = 0; i < SWEEP_BATCH; i++)
+    {
+      if (sweep_next == list_end (&all_list))
+        {
+          if (sweep_decay_cnt == decay_cnt)
+            {
+              sweep_next = NULL;
+              return;
+            }
+          sweep_next = list_begin (&all_list);
+          sweep_decay_cnt = decay_cnt;
+        }
+      thread_refresh_priority (list_entry (sweep_next, struct thread,
+                                           allelem));
+      sweep_next = list_next (sweep_next);
+    }
+}
+
+/* Returns the first timer tick after NOW at which thread_tick()
+   has work to do even if the CPU stays idle until then, or
+   INT64_MAX if there is no such tick. */
+int64_t
+thread_next_event (int64_t now)
+{
+  if (sweep_next != NULL)
+    return now + 1;
+  if (thread_mlfqs)
+    return (now / TIMER_FREQ + 1) * TIMER_FREQ;
+  return INT64_MAX;
+}
+
+/* Accounts for TICKS timer ticks that passed, while the CPU was
+   idle, without a timer interrupt. */
+void
+thread_account_idle (int64_t ticks)
+{
+  idle_ticks += ticks;
 }
 
 /* Prints thread statistics. */
@@ -238,18 +472,6 @@ thread_print_stats (void)
           idle_ticks, kernel_ticks, user_ticks);
 }
 
-/* Comparison function to order threads by priority. */
-bool
-thread_priority_compare (const struct list_elem *a,
-                          const struct list_elem *b,
-                          void *aux) 
-{
-    (void) aux;
-    struct thread *a_entry = list_entry (a, struct thread, elem);
-    struct thread *b_entry = list_entry(b, struct thread, elem);
-    return a_entry->priority > b_entry->priority;
-}
-
 /* Creates a new kernel thread named NAME with the given initial
    PRIORITY, which executes FUNCTION passing AUX as the argument,
    and adds it to the ready queue.  Returns the thread identifier
@@ -278,13 +500,14 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = alloc_thread_page ();
   if (t == NULL)
     return TID_ERROR;
 
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+  trace_name (tid, t->name);
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -323,6 +546,7 @@ thread_block (void)
   ASSERT (intr_get_level () == INTR_OFF);
 
   thread_current ()->status = THREAD_BLOCKED;
+  trace_record (TRACE_BLOCK, thread_current ()->tid, 0);
   schedule ();
 }
 
@@ -344,9 +568,15 @@ thread_unblock (struct thread *t)
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
 
+  thread_refresh_priority (t);
+  if (thread_cfs
+      && min_vruntime > SLEEPER_CREDIT
+      && t->vruntime < min_vruntime - SLEEPER_CREDIT)
+    t->vruntime = min_vruntime - SLEEPER_CREDIT;
   add_to_ready_queue (t);
 
   t->status = THREAD_READY;
+  trace_record (TRACE_UNBLOCK, running_thread ()->tid, t->tid);
 
   intr_set_level (old_level);
 }
@@ -399,6 +629,8 @@ thread_exit (void)
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
+  if (sweep_next == &thread_current ()->allelem)
+    sweep_next = list_next (sweep_next);
   list_remove (&thread_current()->allelem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
@@ -442,7 +674,9 @@ thread_foreach (thread_action_func *func, void *aux)
 }
 
 /* Returns the maximum priority of all threads waiting 
-   for a lock held by the input thread. */
+   for a lock held by the input thread.  Each lock's wait queue
+   is ordered by priority, so only its first waiter is
+   examined. */
 int
 max_waiter_priority (struct thread *t) 
 {
@@ -454,15 +688,11 @@ max_waiter_priority (struct thread *t)
         e = list_next (e)) 
     {
       struct lock *l = list_entry (e, struct lock, lock_elem);
-      /* Find the max priority waiter */
-      if (!list_empty (&l->semaphore.waiters)) 
+      struct avl_elem *first = avl_min (&l->semaphore.waiters);
+      if (first != NULL) 
         {
-          struct list_elem *max_pri_elem = list_min (&l->semaphore.waiters,
-                                                    thread_priority_compare,
-                                                    NULL);
-          struct thread *max_pri_thread = list_entry (max_pri_elem, 
-                                                      struct thread, 
-                                                      elem);
+          struct thread *max_pri_thread = avl_entry (first, struct thread,
+                                                     wait_elem);
           if (max_pri_thread->priority > max_priority)
             max_priority = max_pri_thread->priority; 
         } 
@@ -476,7 +706,7 @@ max_waiter_priority (struct thread *t)
 void
 thread_set_priority (int new_priority) 
 {
-  if (thread_mlfqs)
+  if (thread_mlfqs || thread_cfs)
     return;
 
   /* Avoid race condition with modifying thread struct */
@@ -535,16 +765,8 @@ set_priority (struct thread *t, int new_priority)
     {
       thread_set_priority (new_priority);
     } 
-  else if (t->status == THREAD_BLOCKED) 
-    {
-      t->priority = new_priority;
-    } 
-  else if (t->status == THREAD_READY) 
-    {
-      list_remove(&t->elem); //check this
-      t->priority = new_priority;
-      add_to_ready_queue (t);
-    }
+  else 
+    thread_change_priority (t, new_priority);
   intr_set_level (old_level);
 }
 
@@ -563,12 +785,24 @@ thread_set_nice (int new_nice)
 
   bool should_yield = false;
   struct thread *cur = thread_current ();
+  ASSERT (new_nice >= NICE_MIN && new_nice <= NICE_MAX);
   cur->nice = new_nice;
-  update_priority (cur, NULL);
 
-  struct thread *max_pri = highest_priority_thread ();
-  if (cur->priority < max_pri->priority)
-    should_yield = true;
+  if (thread_cfs)
+    {
+      /* Yield if a ready thread is now behind us. */
+      struct thread *next = highest_priority_thread ();
+      if (next != idle_thread && next->vruntime < cur->vruntime)
+        should_yield = true;
+    }
+  else
+    {
+      update_priority (cur, NULL);
+
+      struct thread *max_pri = highest_priority_thread ();
+      if (cur->priority < max_pri->priority)
+        should_yield = true;
+    }
   
   intr_set_level (old_level);
   if (should_yield)
@@ -600,61 +834,68 @@ thread_get_recent_cpu (void)
 int
 num_ready_threads (void)
 {
-  if (!thread_mlfqs)
-    return list_size (&ready_list);
+  return ready_cnt;
+}
 
-  int total_size = 0;
-  for (int i = 0; i < PRI_MAX; i++) 
+/* Adds t to the back of the run queue for its priority, or to
+   the fair-share scheduler's run queue. */
+void
+add_to_ready_queue (struct thread *t)
+{
+  int bit = PRI_MAX - t->priority;
+
+  ready_cnt++;
+  if (thread_cfs)
     {
-      total_size += list_size (&pri_queues[i]);
+      avl_insert (&cfs_queue, &t->cfs_elem);
+      return;
     }
-  return total_size;
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_map[bit / 32] |= 1u << (bit % 32);
 }
 
-/* Adds t to the proper ready list, in the correct order, based on
-   whether we are in thread_mlfqs mode or not */
-void
-add_to_ready_queue (struct thread *t)
+/* Removes t from the run queue for its priority, or from the
+   fair-share scheduler's run queue. */
+static void
+remove_from_ready_queue (struct thread *t)
 {
-  if (thread_mlfqs)
-    list_push_back (&pri_queues[t->priority], &t->elem);
-  else
-    list_insert_ordered (&ready_list,
-                          &t->elem,
-                          thread_priority_compare,
-                          NULL);
+  int bit = PRI_MAX - t->priority;
+
+  ready_cnt--;
+  if (thread_cfs)
+    {
+      avl_remove (&cfs_queue, &t->cfs_elem);
+      return;
+    }
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->priority]))
+    ready_map[bit / 32] &= ~(1u << (bit % 32));
 }
 
 /* Returns the current highest priority thread, without removing the thread */
 struct thread *
 highest_priority_thread (void)
 {
-  if (thread_mlfqs) 
+  if (thread_cfs)
     {
-      for (int i = PRI_MAX; i >= 0; i--)
-        {
-          if (!list_empty (&pri_queues[i])) 
-            {
-              return list_entry (list_front (&pri_queues[i]),
-                                  struct thread,
-                                  elem);
-            }
-        }
-      return idle_thread;
-    } 
-  else 
-    {
-      if (!list_empty (&ready_list)) 
-        {
-          return list_entry (list_min (&ready_list,
-                              thread_priority_compare,
-                               NULL),
-                            struct thread,
-                            elem);
-        } 
-      else
-        return idle_thread;
+      struct avl_elem *e = avl_min (&cfs_queue);
+      return e != NULL ? avl_entry (e, struct thread, cfs_elem) : idle_thread;
     }
+
+  for (int i = 0; i < READY_MAP_WORDS; i++)
+    if (ready_map[i] != 0)
+      {
+        uint32_t bit;
+        int priority;
+
+        asm ("bsf %1, %0" : "=r" (bit) : "rm" (ready_map[i]));
+        priority = PRI_MAX - (i * 32 + bit);
+        return list_entry (list_front (&ready_queues[priority]),
+                           struct thread, elem);
+      }
+  return idle_thread;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -679,19 +920,8 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
-      /* Re-enable interrupts and wait for the next one.
-
-         The `sti' instruction disables interrupts until the
-         completion of the next instruction, so these two
-         instructions are executed atomically.  This atomicity is
-         important; otherwise, an interrupt could be handled
-         between re-enabling interrupts and waiting for the next
-         one to occur, wasting as much as one clock tick worth of
-         time.
-
-         See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-         7.11.1 "HLT Instruction". */
-      asm volatile ("sti; hlt" : : : "memory");
+      /* Re-enable interrupts and wait for the next one. */
+      timer_idle ();
     }
 }
 
@@ -745,6 +975,8 @@ init_thread (struct thread *t, const char *name, int priority)
   t->priority = priority;
   t->original_priority = priority;
   t->recent_cpu = fix_int (0);
+  t->recent_cpu_sec = decay_cnt;
+  t->vruntime = min_vruntime;
   t->lock_waiting_for = NULL;
   t->magic = THREAD_MAGIC;
   
@@ -790,7 +1022,7 @@ next_thread_to_run (void)
   if (highest_pri == idle_thread)
     return highest_pri;
   
-  list_remove (&highest_pri->elem);
+  remove_from_ready_queue (highest_pri);
   return highest_pri;  
 }
 
@@ -836,10 +1068,37 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      if (page_cache_cnt < PAGE_CACHE_SIZE)
+        {
+          /* Catch use of the dead thread, as palloc_free_page()
+             would by scribbling over the page. */
+          prev->magic = 0;
+          page_cache[page_cache_cnt++] = prev;
+        }
+      else
+        palloc_free_page (prev);
     }
 }
 
+/* Returns a page for a new thread, from the cache of exited
+   threads' pages if possible.  Returns a null pointer if no page
+   is available. */
+static struct thread *
+alloc_thread_page (void)
+{
+  struct thread *t = NULL;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (page_cache_cnt > 0)
+    t = page_cache[--page_cache_cnt];
+  intr_set_level (old_level);
+
+  if (t == NULL)
+    t = palloc_get_page (PAL_ZERO);
+  return t;
+}
+
 /* Schedules a new process.  At entry, interrupts must be off and
    the running process's state must have been changed from
    running to some other state.  This function finds another
@@ -859,7 +1118,10 @@ schedule (void)
   ASSERT (is_thread (next));
 
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      trace_record (TRACE_SWITCH, cur->tid, next->tid);
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
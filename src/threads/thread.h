@@ -1,6 +1,7 @@
 #ifndef THREADS_THREAD_H
 #define THREADS_THREAD_H
 
+#include <avl.h>
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
@@ -25,6 +26,10 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness. */
+#define NICE_MIN -20                    /* Least nice. */
+#define NICE_MAX 20                     /* Nicest. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -75,12 +80,12 @@ typedef int tid_t;
    the `magic' member of the running thread's `struct thread' is
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+/* The `elem' member is an element in the run queue (thread.c).
+   A thread waiting on a semaphore or condition variable is
+   instead on that object's wait queue, through `wait_elem'
+   (synch.c).  The wait queue is ordered by priority, so
+   `priority' must only be changed by code that knows to move the
+   thread within it. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -96,6 +101,9 @@ struct thread
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
+    struct avl_elem wait_elem;          /* Wait queue element. */
+    struct avl *wait_queue;             /* Wait queue on, if any. */
+    uint64_t wait_seq;                  /* Arrival order on wait queue. */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
@@ -106,6 +114,11 @@ struct thread
     unsigned magic;                     /* Detects stack overflow. */
 
     fixed_point_t recent_cpu;           /* Recent cpu usage. */
+    int64_t recent_cpu_sec;             /* Seconds recent_cpu has decayed
+                                           for (see thread.c). */
+
+    uint64_t vruntime;                  /* Weighted run time, for -cfs. */
+    struct avl_elem cfs_elem;           /* Run queue element, for -cfs. */
 
     int nice;                           /* Thread niceness. */
 
@@ -118,18 +131,26 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, use the fair-share scheduler, which runs the ready
+   thread that has had the least CPU time, weighted by niceness.
+   Controlled by kernel command-line option "-cfs". */
+extern bool thread_cfs;
+
 void thread_init (void);
 void thread_start (void);
 
 /* Functions for 4.4BSD scheduler. */
 void calculate_load_avg (void);
 void calculate_recent_cpu (struct thread *t, void *aux);
+void thread_refresh_priority (struct thread *t);
 int thread_get_nice (void);
 void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
 void thread_tick (void);
+int64_t thread_next_event (int64_t now);
+void thread_account_idle (int64_t ticks);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -152,12 +173,8 @@ void thread_foreach (thread_action_func *, void *);
 int thread_get_priority (void);
 void thread_set_priority (int);
 void set_priority (struct thread* t, int new_priority);
+void thread_change_priority (struct thread *t, int priority);
 
 int max_waiter_priority (struct thread *t);
 
-/* Comparison function for priority of two threads. */
-bool thread_priority_compare (const struct list_elem *a,
-                               const struct list_elem *b,
-                               void *aux);
-
 #endif /* threads/thread.h */
@@ -0,0 +1,34 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/thread.h"
+
+/* Kinds of traced event.  The meaning of an event's argument
+   depends on its kind. */
+enum trace_type
+  {
+    TRACE_SWITCH,               /* Switch away; arg is next thread's tid. */
+    TRACE_BLOCK,                /* Thread blocks. */
+    TRACE_UNBLOCK,              /* Thread unblocks thread arg. */
+    TRACE_LOCK_CONTEND,         /* Waits for lock arg. */
+    TRACE_LOCK_ACQUIRE,         /* Acquires lock arg. */
+    TRACE_LOCK_RELEASE,         /* Releases lock arg. */
+    TRACE_FAULT_BEGIN,          /* Page fault at address arg. */
+    TRACE_FAULT_END,            /* Page fault at arg handled. */
+    TRACE_IO_BEGIN,             /* Starts block request arg. */
+    TRACE_IO_END,               /* Block request arg completes. */
+    TRACE_PRIORITY,             /* Thread's priority becomes arg. */
+    TRACE_TYPE_CNT
+  };
+
+/* If true, print the trace when the machine shuts down.
+   Controlled by kernel command-line option "-trace". */
+extern bool trace_print;
+
+void trace_record (enum trace_type, tid_t, uint32_t arg);
+void trace_name (tid_t, const char *name);
+void trace_print_events (void);
+
+#endif /* threads/trace.h */
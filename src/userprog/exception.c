@@ -4,6 +4,7 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -142,6 +143,7 @@ page_fault (struct intr_frame *f)
 
   /* Count page faults. */
   page_fault_cnt++;
+  trace_record (TRACE_FAULT_BEGIN, thread_tid (), (uintptr_t) fault_addr);
 
   /* Determine cause. */
   not_present = (f->error_code & PF_P) == 0;
@@ -156,6 +158,7 @@ page_fault (struct intr_frame *f)
           not_present ? "not present" : "rights violation",
           write ? "writing" : "reading",
           user ? "user" : "kernel");
+  trace_record (TRACE_FAULT_END, thread_tid (), (uintptr_t) fault_addr);
   kill (f);
 }
 